@@ -1,11 +1,17 @@
 #version 330
 
+#ifdef USE_NORMALS
 smooth in vec3 fragNorm;	// Interpolated model-space normal
+#endif
 smooth in vec3 fragColor;  // color
 
 out vec3 outCol;	// Final pixel color
 
 void main() {
+#ifdef USE_NORMALS
 	// Visualize normals as colors
-	outCol = fragColor;  // normalize(fragNorm) * 0.5f + vec3(0.5f);
+	outCol = normalize(fragNorm) * 0.5f + vec3(0.5f);
+#else
+	outCol = fragColor;
+#endif
 }
@@ -0,0 +1,7 @@
+#version 330
+
+out vec3 outCol;	// Final pixel color
+
+void main() {
+	outCol = vec3(0.5);
+}
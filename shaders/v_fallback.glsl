@@ -0,0 +1,23 @@
+#version 330
+
+// Stand-in drawn while the real programs compile: position only, in one flat color
+
+layout(location = 0) in vec3 pos;		// Model-space position
+
+// Per-frame camera constants (binding 0)
+layout(std140) uniform FrameConstants {
+	mat4 view;			// World-to-eye space transform
+	mat4 proj;			// Eye-to-clip space transform
+	mat4 viewProj;		// World-to-clip space transform
+	vec4 cameraPos;		// World-space eye position
+};
+
+// Constants of the object being drawn (binding 1)
+layout(std140) uniform ObjectConstants {
+	mat4 model;			// Stored position to world space transform
+	float octScale;		// Unused here
+};
+
+void main() {
+	gl_Position = viewProj * (model * vec4(pos, 1.0));
+}
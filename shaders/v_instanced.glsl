@@ -0,0 +1,65 @@
+#version 330
+
+// Compiled in variants (see permutations.hpp):
+//   USE_NORMALS	normals are passed on to the fragment shader; otherwise they are not read
+//   OCT_NORMALS	they are octahedral-encoded, to be decoded with octScale
+
+layout(location = 0) in vec3 pos;		// Model-space position
+#ifdef USE_NORMALS
+layout(location = 1) in vec3 norm;		// Model-space normal, or octahedral-encoded in .xy
+#endif
+layout(location = 2) in vec3 color;		// color
+
+#ifdef USE_NORMALS
+smooth out vec3 fragNorm;	// Model-space interpolated normal
+#endif
+smooth out vec3 fragColor;  // color
+
+uniform samplerBuffer instances;	// Model-to-world transform of each instance, four columns apiece
+uniform int instanceBase;			// Entry of the first instance of this draw
+#ifdef OCT_NORMALS
+uniform float octScale;				// Maps an octahedral-encoded normal to [-1, 1]
+#endif
+
+// Per-frame camera constants (binding 0)
+layout(std140) uniform FrameConstants {
+	mat4 view;			// World-to-eye space transform
+	mat4 proj;			// Eye-to-clip space transform
+	mat4 viewProj;		// World-to-clip space transform
+	vec4 cameraPos;		// World-space eye position
+};
+
+#if defined(OCT_NORMALS) && !defined(USE_NORMALS)
+#error OCT_NORMALS needs USE_NORMALS
+#endif
+
+#ifdef OCT_NORMALS
+// Decode a normal stored as a point on the unfolded octahedron
+vec3 octDecode(vec2 e) {
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
+#endif
+
+void main() {
+	// Fetch this instance's transform
+	int i = 4 * (instanceBase + gl_InstanceID);
+	mat4 model = mat4(texelFetch(instances, i), texelFetch(instances, i + 1),
+		texelFetch(instances, i + 2), texelFetch(instances, i + 3));
+
+	// Transform vertex position
+	gl_Position = viewProj * (model * vec4(pos, 1.0));
+
+	// Interpolate normals
+#ifdef USE_NORMALS
+#ifdef OCT_NORMALS
+	fragNorm = octDecode(norm.xy * octScale);
+#else
+	fragNorm = norm;
+#endif
+#endif
+
+	fragColor = color;
+}
@@ -0,0 +1,233 @@
+#define NOMINMAX
+#include "arena.hpp"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+// Index data is allocated in units of this many bytes, which keeps 32-bit indices aligned
+static const size_t indexUnit = 4;
+
+RangeAllocator::RangeAllocator(size_t capacity) : total(0), inUse(0) {
+	reset(capacity, 0);
+}
+
+size_t RangeAllocator::allocate(size_t size) {
+	if (size == 0)
+		return 0;
+	for (auto it = freeList.begin(); it != freeList.end(); ++it) {
+		if (it->second < size)
+			continue;
+		size_t offset = it->first;
+		size_t remaining = it->second - size;
+		freeList.erase(it);
+		if (remaining)
+			freeList[offset + size] = remaining;
+		inUse += size;
+		return offset;
+	}
+	return npos;
+}
+
+void RangeAllocator::free(size_t offset, size_t size) {
+	if (size == 0)
+		return;
+	inUse -= size;
+	auto next = freeList.lower_bound(offset);
+	// Merge with the free range that ends where this one starts
+	if (next != freeList.begin()) {
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == offset) {
+			offset = prev->first;
+			size += prev->second;
+			freeList.erase(prev);
+		}
+	}
+	// and with the one that starts where it ends
+	if (next != freeList.end() && offset + size == next->first) {
+		size += next->second;
+		freeList.erase(next);
+	}
+	freeList[offset] = size;
+}
+
+void RangeAllocator::reset(size_t capacity, size_t used) {
+	freeList.clear();
+	total = capacity;
+	inUse = used;
+	if (used < capacity)
+		freeList[used] = capacity - used;
+}
+
+size_t RangeAllocator::largestFree() const {
+	size_t largest = 0;
+	for (auto& f : freeList)
+		largest = std::max(largest, f.second);
+	return largest;
+}
+
+GeometryArena::GeometryArena(Mesh::VertexFormat format, size_t vertexCapacity, size_t indexCapacity) :
+	format(format),
+	stride(Mesh::vertexSize(format)),
+	relocations(0),
+	vao(0),
+	vbuf(0),
+	ibuf(0) {
+	vertexCapacity = std::max<size_t>(vertexCapacity, 1);
+	indexCapacity = std::max<size_t>((indexCapacity + indexUnit - 1) / indexUnit, 1);
+	glGenVertexArrays(1, &vao);
+	relocate(vertexCapacity, indexCapacity);
+	relocations = 0;  // the initial allocation does not count
+}
+
+GeometryArena::~GeometryArena() {
+	if (vao) glDeleteVertexArrays(1, &vao);
+	if (vbuf) glDeleteBuffers(1, &vbuf);
+	if (ibuf) glDeleteBuffers(1, &ibuf);
+}
+
+GeometryArena::Handle GeometryArena::reserve(size_t vertexCount, size_t indexBytes) {
+	const size_t indexUnits = (indexBytes + indexUnit - 1) / indexUnit;
+	size_t v = vertexAlloc.allocate(vertexCount);
+	size_t i = indexAlloc.allocate(indexUnits);
+	if (v == RangeAllocator::npos || i == RangeAllocator::npos) {
+		if (v != RangeAllocator::npos) vertexAlloc.free(v, vertexCount);
+		if (i != RangeAllocator::npos) indexAlloc.free(i, indexUnits);
+		// Compact, doubling the buffers until the free space suffices
+		size_t vertexCapacity = vertexAlloc.capacity(), indexCapacity = indexAlloc.capacity();
+		while (vertexCapacity - vertexAlloc.used() < vertexCount)
+			vertexCapacity *= 2;
+		while (indexCapacity - indexAlloc.used() < indexUnits)
+			indexCapacity *= 2;
+		if ((uint64_t)vertexCapacity > 0x7fffffff) {
+			std::stringstream ss;
+			ss << "Geometry arena cannot hold " << vertexCapacity << " vertices" << std::endl;
+			throw std::runtime_error(ss.str());
+		}
+		relocate(vertexCapacity, indexCapacity);
+		v = vertexAlloc.allocate(vertexCount);
+		i = indexAlloc.allocate(indexUnits);
+	}
+
+	Handle h;
+	if (!freeHandles.empty()) {
+		h = freeHandles.back();
+		freeHandles.pop_back();
+	} else {
+		h = (Handle)ranges.size();
+		ranges.push_back(Range());
+		live.push_back(false);
+	}
+	ranges[h] = Range{ (GLint)v, (GLsizei)vertexCount, i * indexUnit, indexBytes };
+	live[h] = true;
+	return h;
+}
+
+GeometryArena::Handle GeometryArena::allocate(const void* vertices, size_t vertexCount, const void* indices, size_t indexBytes) {
+	Handle h = reserve(vertexCount, indexBytes);
+	const Range& r = ranges[h];
+	if (vertexCount) {
+		glBindBuffer(GL_ARRAY_BUFFER, vbuf);
+		glBufferSubData(GL_ARRAY_BUFFER, r.baseVertex * stride, vertexCount * stride, vertices);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	if (indexBytes) {
+		// The element array binding is part of the VAO state, so go through another target
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ibuf);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, r.indexOffset, indexBytes, indices);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	return h;
+}
+
+GeometryArena::Handle GeometryArena::copy(GLuint srcVertices, size_t vertexCount, GLuint srcIndices, size_t indexBytes) {
+	Handle h = reserve(vertexCount, indexBytes);
+	const Range& r = ranges[h];
+	// Binding the sources here also makes changes made to them on another context visible
+	if (vertexCount) {
+		glBindBuffer(GL_COPY_READ_BUFFER, srcVertices);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, vbuf);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, r.baseVertex * stride, vertexCount * stride);
+	}
+	if (indexBytes) {
+		glBindBuffer(GL_COPY_READ_BUFFER, srcIndices);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ibuf);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, r.indexOffset, indexBytes);
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return h;
+}
+
+void GeometryArena::free(Handle h) {
+	if (h >= ranges.size() || !live[h])
+		return;
+	const Range& r = ranges[h];
+	vertexAlloc.free(r.baseVertex, r.vertexCount);
+	indexAlloc.free(r.indexOffset / indexUnit, (r.indexBytes + indexUnit - 1) / indexUnit);
+	live[h] = false;
+	freeHandles.push_back(h);
+}
+
+void GeometryArena::compact() {
+	relocate(vertexAlloc.capacity(), indexAlloc.capacity());
+}
+
+void GeometryArena::relocate(size_t vertexCapacity, size_t indexCapacity) {
+	GLuint newVbuf, newIbuf;
+	glGenBuffers(1, &newVbuf);
+	glGenBuffers(1, &newIbuf);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newVbuf);
+	glBufferData(GL_COPY_WRITE_BUFFER, vertexCapacity * stride, NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newIbuf);
+	glBufferData(GL_COPY_WRITE_BUFFER, indexCapacity * indexUnit, NULL, GL_STATIC_DRAW);
+
+	// Copy the live ranges to the front of the new buffers, in their current order
+	std::vector<Handle> order;
+	for (Handle h = 0; h < ranges.size(); h++) {
+		if (live[h])
+			order.push_back(h);
+	}
+	std::sort(order.begin(), order.end(), [&](Handle a, Handle b) { return ranges[a].baseVertex < ranges[b].baseVertex; });
+	size_t vertexTop = 0;
+	if (vbuf) {
+		glBindBuffer(GL_COPY_READ_BUFFER, vbuf);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, newVbuf);
+		for (Handle h : order) {
+			Range& r = ranges[h];
+			if (r.vertexCount)
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, r.baseVertex * stride, vertexTop * stride, r.vertexCount * stride);
+			r.baseVertex = (GLint)vertexTop;
+			vertexTop += r.vertexCount;
+		}
+	}
+	std::sort(order.begin(), order.end(), [&](Handle a, Handle b) { return ranges[a].indexOffset < ranges[b].indexOffset; });
+	size_t indexTop = 0;
+	if (ibuf) {
+		glBindBuffer(GL_COPY_READ_BUFFER, ibuf);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, newIbuf);
+		for (Handle h : order) {
+			Range& r = ranges[h];
+			if (r.indexBytes)
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, r.indexOffset, indexTop * indexUnit, r.indexBytes);
+			r.indexOffset = indexTop * indexUnit;
+			indexTop += (r.indexBytes + indexUnit - 1) / indexUnit;
+		}
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	if (vbuf) glDeleteBuffers(1, &vbuf);
+	if (ibuf) glDeleteBuffers(1, &ibuf);
+	vbuf = newVbuf;
+	ibuf = newIbuf;
+	vertexAlloc.reset(vertexCapacity, vertexTop);
+	indexAlloc.reset(indexCapacity, indexTop);
+	relocations++;
+
+	// Point the vertex array at the new buffers
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbuf);
+	Mesh::setVertexAttribs(format);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibuf);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
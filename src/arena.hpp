@@ -0,0 +1,105 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <map>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "gl_core_3_3.h"
+#include "mesh.hpp"
+
+// First-fit allocator of ranges in [0, capacity), in whatever unit the caller uses.
+// Freed ranges are merged with their free neighbors.
+class RangeAllocator {
+public:
+	static const size_t npos = ~size_t(0);
+
+	explicit RangeAllocator(size_t capacity = 0);
+
+	// Offset of a new range of size units, or npos if no free range is large enough
+	size_t allocate(size_t size);
+	void free(size_t offset, size_t size);
+	// Start over with [0, used) taken and the rest free, e.g. after moving every range to the front
+	void reset(size_t capacity, size_t used);
+
+	// access:
+	inline size_t capacity() const { return total; }
+	inline size_t used() const { return inUse; }
+	inline size_t freeBlocks() const { return freeList.size(); }
+	size_t largestFree() const;
+
+protected:
+	std::map<size_t, size_t> freeList;	// Offset -> size of each free range
+	size_t total;	// Units managed
+	size_t inUse;	// Units allocated
+};
+
+// Vertex and index data of many meshes suballocated from one vertex buffer and one index
+// buffer, drawn through a single vertex array object. Meshes refer to their data by handle;
+// offsets change when the arena is compacted, so they are looked up at draw time. Indices are
+// local to each mesh (drawn with a base vertex), so 16- and 32-bit index lists can share the
+// index buffer.
+class GeometryArena {
+public:
+	typedef uint32_t Handle;
+	static const Handle invalidHandle = ~Handle(0);
+
+	// Where a mesh's data lives
+	struct Range {
+		GLint baseVertex;		// First vertex
+		GLsizei vertexCount;
+		size_t indexOffset;		// Byte offset of the first index
+		size_t indexBytes;
+	};
+
+	// Capacities are the initial sizes; the buffers grow as needed
+	GeometryArena(Mesh::VertexFormat format, size_t vertexCapacity = 1 << 18, size_t indexCapacity = 1 << 22);
+	~GeometryArena();
+	// Disallow copy, move, & assignment
+	GeometryArena(const GeometryArena& other) = delete;
+	GeometryArena& operator=(const GeometryArena& other) = delete;
+	GeometryArena(GeometryArena&& other) = delete;
+	GeometryArena& operator=(GeometryArena&& other) = delete;
+
+	// Copy vertices already packed in the arena's format, and indexBytes of indices, into the
+	// buffers. When no free range fits, the live data is compacted first, into larger buffers if
+	// the free space falls short in total.
+	Handle allocate(const void* vertices, size_t vertexCount, const void* indices, size_t indexBytes);
+	// As allocate(), but copy the data on the GPU from the start of other buffers (e.g. staged
+	// on a loader thread's context); srcIndices may be 0 when indexBytes is
+	Handle copy(GLuint srcVertices, size_t vertexCount, GLuint srcIndices, size_t indexBytes);
+	void free(Handle h);
+	// Move all live data to the front of the buffers, leaving one free range in each
+	void compact();
+
+	// Bind the shared vertex array; meshes in the arena draw with it bound
+	inline void bind() const { glBindVertexArray(vao); }
+	inline const Range& get(Handle h) const { return ranges[h]; }
+	inline Mesh::VertexFormat vertexFormat() const { return format; }
+
+	// Statistics
+	inline const RangeAllocator& vertexSpace() const { return vertexAlloc; }	// In vertices
+	inline const RangeAllocator& indexSpace() const { return indexAlloc; }		// In 4-byte units
+	inline size_t getRelocations() const { return relocations; }
+
+protected:
+	// Take space for a new handle, relocating if needed
+	Handle reserve(size_t vertexCount, size_t indexBytes);
+	// Copy the live ranges, packed, into new buffers of the given capacities
+	void relocate(size_t vertexCapacity, size_t indexCapacity);
+
+	Mesh::VertexFormat format;
+	size_t stride;			// Bytes per vertex
+	std::vector<Range> ranges;				// Data of each handle
+	std::vector<bool> live;					// Whether each handle is allocated
+	std::vector<Handle> freeHandles;		// Handles to reuse
+	RangeAllocator vertexAlloc, indexAlloc;
+	size_t relocations;		// Times the data was compacted or grown
+
+	// OpenGL resources
+	GLuint vao;		// Vertex array object over vbuf and ibuf
+	GLuint vbuf;	// Vertex buffer
+	GLuint ibuf;	// Index buffer
+};
+
+#endif
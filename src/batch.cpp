@@ -0,0 +1,112 @@
+#define NOMINMAX
+#include "batch.hpp"
+#include <algorithm>
+#include <limits>
+#include "frustum.hpp"
+#include "threadpool.hpp"
+
+// Split instances [first, last) at the median of the longest axis of their centers until each
+// group fits in a batch
+static void splitGroups(std::vector<size_t>& order, size_t first, size_t last, const std::vector<glm::vec3>& centers,
+	const std::vector<StaticInstance>& instances, std::vector<std::pair<size_t, size_t>>& groups) {
+	size_t vertices = 0;
+	glm::vec3 cmin(std::numeric_limits<float>::max()), cmax(std::numeric_limits<float>::lowest());
+	for (size_t i = first; i < last; i++) {
+		vertices += instances[order[i]].geom->vertices.size();
+		cmin = glm::min(cmin, centers[order[i]]);
+		cmax = glm::max(cmax, centers[order[i]]);
+	}
+	if (vertices <= maxBatchVertices || last - first == 1) {
+		groups.push_back(std::make_pair(first, last));
+		return;
+	}
+	glm::vec3 extent = cmax - cmin;
+	int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+	size_t mid = first + (last - first) / 2;
+	std::nth_element(order.begin() + first, order.begin() + mid, order.begin() + last,
+		[&](size_t a, size_t b) { return centers[a][axis] < centers[b][axis]; });
+	splitGroups(order, first, mid, centers, instances, groups);
+	splitGroups(order, mid, last, centers, instances, groups);
+}
+
+// Append the instances order[first, last) to one world-space geometry
+static Mesh::Geometry mergeGroup(const std::vector<size_t>& order, size_t first, size_t last,
+	const std::vector<StaticInstance>& instances) {
+	Mesh::Geometry batch;
+	batch.minBB = glm::vec3(std::numeric_limits<float>::max());
+	batch.maxBB = glm::vec3(std::numeric_limits<float>::lowest());
+	size_t levels = 1, vertexCount = 0, indexCount = 0;
+	for (size_t i = first; i < last; i++) {
+		const Mesh::Geometry& g = *instances[order[i]].geom;
+		levels = std::max(levels, g.lods.size());
+		vertexCount += g.vertices.size();
+		indexCount += g.indices.size();
+	}
+	batch.vertices.reserve(vertexCount);
+	batch.indices.reserve(indexCount);
+
+	// Transform the vertices of every member, remembering where each one starts
+	std::vector<GLuint> base(last - first);
+	for (size_t i = first; i < last; i++) {
+		const StaticInstance& inst = instances[order[i]];
+		const glm::mat3 normalMat = glm::transpose(glm::inverse(glm::mat3(inst.modelMat)));
+		base[i - first] = (GLuint)batch.vertices.size();
+		for (const Mesh::Vertex& v : inst.geom->vertices) {
+			Mesh::Vertex w;
+			w.pos = glm::vec3(inst.modelMat * glm::vec4(v.pos, 1.0f));
+			glm::vec3 n = normalMat * v.norm;
+			float len = glm::length(n);
+			w.norm = len > 0.0f ? n / len : n;
+			w.color = v.color;
+			batch.minBB = glm::min(batch.minBB, w.pos);
+			batch.maxBB = glm::max(batch.maxBB, w.pos);
+			batch.vertices.push_back(w);
+		}
+	}
+
+	// Then each level of detail, as the members' matching levels in a row
+	for (size_t level = 0; level < levels; level++) {
+		Mesh::Lod lod{ (GLuint)batch.indices.size(), 0, 0.0f };
+		for (size_t i = first; i < last; i++) {
+			const StaticInstance& inst = instances[order[i]];
+			const Mesh::Geometry& g = *inst.geom;
+			Mesh::Lod src = g.lods.empty() ? Mesh::Lod{ 0, (GLuint)g.indices.size(), 0.0f } : g.lods[std::min(level, g.lods.size() - 1)];
+			float scale = glm::max(glm::length(glm::vec3(inst.modelMat[0])),
+				glm::max(glm::length(glm::vec3(inst.modelMat[1])), glm::length(glm::vec3(inst.modelMat[2]))));
+			lod.error = std::max(lod.error, src.error * scale);
+			// Mirroring transforms flip the winding, so swap two corners back
+			bool flip = glm::determinant(glm::mat3(inst.modelMat)) < 0.0f;
+			for (GLuint c = src.first; c + 2 < src.first + src.count; c += 3) {
+				GLuint a = g.indices[c], b = g.indices[c + 1], d = g.indices[c + 2];
+				if (flip)
+					std::swap(b, d);
+				batch.indices.push_back(base[i - first] + a);
+				batch.indices.push_back(base[i - first] + b);
+				batch.indices.push_back(base[i - first] + d);
+			}
+		}
+		lod.count = (GLuint)batch.indices.size() - lod.first;
+		batch.lods.push_back(lod);
+	}
+	return batch;
+}
+
+std::vector<Mesh::Geometry> buildStaticBatches(const std::vector<StaticInstance>& instances) {
+	std::vector<glm::vec3> centers(instances.size());
+	std::vector<size_t> order(instances.size());
+	for (size_t i = 0; i < instances.size(); i++) {
+		glm::vec3 minBB, maxBB;
+		transformBox(instances[i].modelMat, instances[i].geom->minBB, instances[i].geom->maxBB, minBB, maxBB);
+		centers[i] = 0.5f * (minBB + maxBB);
+		order[i] = i;
+	}
+	std::vector<std::pair<size_t, size_t>> groups;
+	if (!instances.empty())
+		splitGroups(order, 0, instances.size(), centers, instances, groups);
+
+	std::vector<Mesh::Geometry> batches(groups.size());
+	ThreadPool::instance().parallelFor(groups.size(), [&](size_t g) {
+		batches[g] = mergeGroup(order, groups[g].first, groups[g].second, instances);
+	});
+	return batches;
+}
@@ -0,0 +1,25 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <vector>
+#include <cstddef>
+#include <glm/glm.hpp>
+#include "mesh.hpp"
+
+// Most vertices merged into one batch, so batches keep 16-bit indices. Larger models are
+// pre-transformed on their own.
+const size_t maxBatchVertices = 1 << 16;
+
+// One placement of a model that never moves
+struct StaticInstance {
+	const Mesh::Geometry* geom;	// Model-space geometry, with its levels of detail
+	glm::mat4 modelMat;			// Model to world coordinates
+};
+
+// Split the instances into spatially coherent groups of at most maxBatchVertices vertices,
+// transform each group's vertices (normals included) into world space on the thread pool, and
+// merge them into one geometry per group. Level k of a batch draws level k of each member (or
+// its coarsest), with the largest world-space error among them.
+std::vector<Mesh::Geometry> buildStaticBatches(const std::vector<StaticInstance>& instances);
+
+#endif
@@ -0,0 +1,462 @@
+#define NOMINMAX
+#include "bench.hpp"
+#include <iostream>
+#include <iomanip>
+#include <filesystem>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <cmath>
+#include <cstdlib>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/constants.hpp>
+#include "mesh.hpp"
+#include "meshcache.hpp"
+#include "meshopt.hpp"
+#include "simplify.hpp"
+#include "bvh.hpp"
+#include "renderqueue.hpp"
+#include "arena.hpp"
+#include "batch.hpp"
+#include "frustum.hpp"
+#include "threadpool.hpp"
+namespace fs = std::filesystem;
+
+// List the .obj and .ply files in the models/ directory
+static std::vector<fs::path> findModelFiles() {
+	std::vector<fs::path> files;
+	for (auto& di : fs::directory_iterator("models")) {
+		std::string ext = di.path().extension().string();
+		if (di.is_regular_file() && (ext == ".obj" || ext == ".ply"))
+			files.push_back(di.path());
+	}
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+// Measure the parsing throughput of every model in the models/ directory
+static void parseReport() {
+	using clock = std::chrono::steady_clock;
+	std::vector<fs::path> files = findModelFiles();
+
+	std::cout << std::left << std::setw(24) << "model" << std::right
+		<< std::setw(10) << "MB" << std::setw(12) << "tris" << std::setw(10) << "ms"
+		<< std::setw(10) << "MB/s" << std::setw(12) << "Mtris/s"
+		<< std::setw(12) << "verts" << std::setw(10) << "vram x" << std::endl;
+	double totalMB = 0.0, totalTris = 0.0, totalSec = 0.0;
+	std::cout << std::fixed;
+	for (auto& path : files) {
+		// Take the best of several runs so the page cache is warm and timer noise is hidden
+		double best = 1e30;
+		size_t tris = 0, verts = 0;
+		double spent = 0.0;
+		for (int run = 0; run < 20 && (run < 3 || spent < 0.5); run++) {
+			auto t0 = clock::now();
+			Mesh::Geometry geom = Mesh::readFile(path.string(), false, false);  // always parse, nothing else
+			double sec = std::chrono::duration<double>(clock::now() - t0).count();
+			best = std::min(best, sec);
+			spent += sec;
+			tris = geom.indices.size() / 3;
+			verts = geom.vertices.size();
+		}
+		// GPU memory of the old per-corner arrays over the welded vertices plus 16/32-bit indices
+		double flatBytes = 3.0 * tris * sizeof(Mesh::Vertex);
+		double indexedBytes = std::min(flatBytes, verts * sizeof(Mesh::Vertex) + 3.0 * tris * (verts <= 0x10000 ? 2 : 4));
+		double mb = fs::file_size(path) / (1024.0 * 1024.0);
+		totalMB += mb;
+		totalTris += tris;
+		totalSec += best;
+		std::cout << std::left << std::setw(24) << path.filename().string() << std::right
+			<< std::setprecision(3) << std::setw(10) << mb << std::setw(12) << tris
+			<< std::setw(10) << best * 1000.0 << std::setprecision(1) << std::setw(10) << mb / best
+			<< std::setprecision(2) << std::setw(12) << tris / best / 1e6
+			<< std::setw(12) << verts << std::setw(10) << flatBytes / indexedBytes << std::endl;
+	}
+	if (totalSec > 0.0) {
+		std::cout << std::left << std::setw(24) << "total" << std::right
+			<< std::setprecision(3) << std::setw(10) << totalMB << std::setw(12) << (size_t)totalTris
+			<< std::setw(10) << totalSec * 1000.0 << std::setprecision(1) << std::setw(10) << totalMB / totalSec
+			<< std::setprecision(2) << std::setw(12) << totalTris / totalSec / 1e6 << std::endl;
+	}
+}
+
+// Build or refresh the binary cache of every model in the models/ directory
+static void prewarmCache() {
+	using clock = std::chrono::steady_clock;
+	std::vector<fs::path> files = findModelFiles();
+	std::vector<std::string> status(files.size());
+	std::vector<double> cacheMs(files.size(), 0.0);
+
+	ThreadPool::instance().parallelFor(files.size(), [&](size_t i) {
+		std::string filename = files[i].string();
+		try {
+			Mesh::Geometry geom;
+			if (readMeshCache(filename, geom)) {
+				status[i] = "up to date";
+			} else {
+				geom = Mesh::readFile(filename, false);
+				status[i] = writeMeshCache(filename, geom) ? "written" : "write failed";
+			}
+			// Time a load through the cache
+			auto t0 = clock::now();
+			if (readMeshCache(filename, geom))
+				cacheMs[i] = std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+		} catch (const std::exception& e) {
+			status[i] = e.what();
+		}
+	});
+
+	std::cout << std::left << std::setw(24) << "model" << std::setw(16) << "cache"
+		<< std::right << std::setw(10) << "load ms" << std::endl;
+	std::cout << std::fixed << std::setprecision(3);
+	for (size_t i = 0; i < files.size(); i++) {
+		std::cout << std::left << std::setw(24) << files[i].filename().string() << std::setw(16) << status[i]
+			<< std::right << std::setw(10) << cacheMs[i] << std::endl;
+	}
+}
+
+// Report the size and the largest quantization error of each compact vertex format
+static void quantizeReport() {
+	std::vector<fs::path> files = findModelFiles();
+	const Mesh::VertexFormat formats[] = { Mesh::VERTEX_COMPACT, Mesh::VERTEX_SMALL };
+	const char* formatNames[] = { "compact", "small" };
+
+	std::cout << std::left << std::setw(24) << "model" << std::setw(10) << "format" << std::right
+		<< std::setw(8) << "bytes" << std::setw(12) << "vram KB" << std::setw(14) << "pos err"
+		<< std::setw(12) << "pos err %" << std::setw(12) << "norm deg" << std::setw(12) << "color err" << std::endl;
+	for (auto& path : files) {
+		Mesh::Geometry geom = Mesh::readFile(path.string());
+		float diag = glm::length(geom.maxBB - geom.minBB);
+		for (int f = 0; f < 2; f++) {
+			Mesh::QuantizationError err;
+			std::vector<unsigned char> packed = Mesh::packVertices(geom.vertices, geom.minBB, geom.maxBB, formats[f], &err);
+			std::cout << std::left << std::setw(24) << path.filename().string() << std::setw(10) << formatNames[f]
+				<< std::right << std::setw(8) << Mesh::vertexSize(formats[f])
+				<< std::fixed << std::setprecision(1) << std::setw(12) << packed.size() / 1024.0
+				<< std::scientific << std::setprecision(2) << std::setw(14) << err.position
+				<< std::fixed << std::setprecision(4) << std::setw(12) << (diag > 0.0f ? 100.0f * err.position / diag : 0.0f)
+				<< std::setprecision(3) << std::setw(12) << err.normal << std::setprecision(4) << std::setw(12) << err.color << std::endl;
+		}
+		std::cout << std::left << std::setw(24) << path.filename().string() << std::setw(10) << "float"
+			<< std::right << std::setw(8) << sizeof(Mesh::Vertex) << std::fixed << std::setprecision(1)
+			<< std::setw(12) << geom.vertices.size() * sizeof(Mesh::Vertex) / 1024.0 << std::endl;
+	}
+}
+
+// Report the vertex cache efficiency of every model before and after the load-time optimization
+static void optimizeReport() {
+	using clock = std::chrono::steady_clock;
+	std::vector<fs::path> files = findModelFiles();
+
+	std::cout << std::left << std::setw(24) << "model" << std::right << std::setw(10) << "tris"
+		<< std::setw(10) << "verts" << std::setw(12) << "ACMR in" << std::setw(12) << "ACMR out"
+		<< std::setw(12) << "ATVR in" << std::setw(12) << "ATVR out" << std::setw(10) << "ms" << std::endl;
+	std::cout << std::fixed;
+	for (auto& path : files) {
+		Mesh::Geometry geom = Mesh::readFile(path.string(), false, false);
+		VertexCacheStats before = analyzeVertexCache(geom.indices, geom.vertices.size());
+		auto t0 = clock::now();
+		optimizeMesh(geom);
+		double ms = std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+		VertexCacheStats after = analyzeVertexCache(geom.indices, geom.vertices.size());
+		std::cout << std::left << std::setw(24) << path.filename().string() << std::right
+			<< std::setw(10) << geom.indices.size() / 3 << std::setw(10) << geom.vertices.size()
+			<< std::setprecision(3) << std::setw(12) << before.acmr << std::setw(12) << after.acmr
+			<< std::setw(12) << before.atvr << std::setw(12) << after.atvr
+			<< std::setprecision(1) << std::setw(10) << ms << std::endl;
+	}
+	std::cout << "(FIFO cache of " << vertexCacheSize << " vertices)" << std::endl;
+}
+
+// List the levels of detail built for every model, and how long building them takes
+static void lodReport() {
+	using clock = std::chrono::steady_clock;
+	std::vector<fs::path> files = findModelFiles();
+	std::vector<Mesh::Geometry> geoms(files.size());
+	for (size_t i = 0; i < files.size(); i++)
+		geoms[i] = Mesh::readFile(files[i].string(), false, false);
+
+	// Build the chains on the pool, one model per task, as the loaders do
+	auto t0 = clock::now();
+	ThreadPool::instance().parallelFor(files.size(), [&](size_t i) { buildLods(geoms[i]); });
+	double ms = std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+
+	std::cout << std::left << std::setw(24) << "model" << std::right << std::setw(6) << "lod"
+		<< std::setw(10) << "tris" << std::setw(12) << "error" << std::setw(12) << "error %" << std::endl;
+	std::cout << std::fixed;
+	for (size_t i = 0; i < files.size(); i++) {
+		float diag = glm::length(geoms[i].maxBB - geoms[i].minBB);
+		for (size_t l = 0; l < geoms[i].lods.size(); l++) {
+			const Mesh::Lod& lod = geoms[i].lods[l];
+			std::cout << std::left << std::setw(24) << files[i].filename().string() << std::right
+				<< std::setw(6) << l << std::setw(10) << lod.count / 3
+				<< std::setprecision(5) << std::setw(12) << lod.error
+				<< std::setprecision(3) << std::setw(12) << (diag > 0.0f ? 100.0f * lod.error / diag : 0.0f) << std::endl;
+		}
+	}
+	std::cout << "built in " << std::setprecision(1) << ms << " ms on " << ThreadPool::instance().concurrency()
+		<< " threads" << std::endl;
+}
+
+// Time building the scene BVH and querying it, over a synthetic city of placed objects,
+// and check the queries against testing every object
+static void bvhReport(size_t count) {
+	using clock = std::chrono::steady_clock;
+	auto ms = [](clock::time_point t0) { return std::chrono::duration<double, std::milli>(clock::now() - t0).count(); };
+
+	// Boxes of 1-10 units on a square ground, about 10 units apart
+	std::mt19937 rng(1234);
+	float side = 10.0f * std::sqrt((float)count);
+	std::uniform_real_distribution<float> ground(-0.5f * side, 0.5f * side), size(1.0f, 10.0f);
+	std::vector<glm::vec3> minBBs(count), maxBBs(count);
+	for (size_t i = 0; i < count; i++) {
+		glm::vec3 pos(ground(rng), 0.0f, ground(rng)), extent(size(rng), size(rng), size(rng));
+		minBBs[i] = pos - glm::vec3(0.5f * extent.x, 0.0f, 0.5f * extent.z);
+		maxBBs[i] = minBBs[i] + extent;
+	}
+
+	Bvh bvh;
+	auto t0 = clock::now();
+	bvh.build(minBBs, maxBBs);
+	double buildMs = ms(t0);
+
+	// Ground-level cameras looking in random directions
+	const int views = 200;
+	std::uniform_real_distribution<float> angle(0.0f, glm::two_pi<float>());
+	glm::mat4 proj = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f);
+	std::vector<uint32_t> visible;
+	visible.reserve(count);
+	double queryMs = 0.0, bruteMs = 0.0;
+	size_t visibleTotal = 0, mismatches = 0;
+	for (int v = 0; v < views; v++) {
+		glm::vec3 eye(ground(rng), 1.5f, ground(rng));
+		float a = angle(rng);
+		Frustum frustum(proj * glm::lookAt(eye, eye + glm::vec3(std::cos(a), 0.0f, std::sin(a)), glm::vec3(0.0f, 1.0f, 0.0f)));
+		visible.clear();
+		t0 = clock::now();
+		bvh.queryFrustum(frustum, visible);
+		queryMs += ms(t0);
+		visibleTotal += visible.size();
+
+		t0 = clock::now();
+		size_t brute = 0;
+		for (size_t i = 0; i < count; i++)
+			brute += frustum.intersects(minBBs[i], maxBBs[i]);
+		bruteMs += ms(t0);
+		mismatches += brute != visible.size();
+	}
+
+	// The other queries, each against a linear scan
+	std::vector<uint32_t> overlap;
+	std::vector<std::pair<float, uint32_t>> hits, nearest;
+	glm::vec3 center(0.0f, 0.0f, 0.0f);
+	t0 = clock::now();
+	bvh.queryOverlap(center - glm::vec3(50.0f), center + glm::vec3(50.0f), overlap);
+	bvh.queryRay(glm::vec3(-0.5f * side, 2.0f, 0.0f), glm::normalize(glm::vec3(1.0f, 0.0f, 0.01f)), side, hits);
+	bvh.queryNearest(center, 16, nearest);
+	double otherMs = ms(t0);
+	size_t overlapBrute = 0;
+	for (size_t i = 0; i < count; i++) {
+		overlapBrute += glm::all(glm::lessThanEqual(minBBs[i], center + glm::vec3(50.0f))) &&
+			glm::all(glm::lessThanEqual(center - glm::vec3(50.0f), maxBBs[i]));
+	}
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << count << " objects, " << bvh.nodeCount() << " nodes, built in " << buildMs << " ms on "
+		<< ThreadPool::instance().concurrency() << " threads" << std::endl;
+	std::cout << "frustum query: " << queryMs / views << " ms (linear scan " << bruteMs / views << " ms), "
+		<< visibleTotal / views << " visible on average, " << mismatches << " mismatches" << std::endl;
+	std::cout << "overlap " << overlap.size() << " (linear scan " << overlapBrute << "), ray " << hits.size()
+		<< " hits, 16 nearest within " << (nearest.empty() ? 0.0f : nearest.back().first) << " units: "
+		<< otherMs << " ms" << std::endl;
+}
+
+// Time sorting a render queue of count packets (64 models, 6 levels of detail, random depths)
+// against std::sort, and re-sorting it once it is in order
+static void queueReport(size_t count) {
+	using clock = std::chrono::steady_clock;
+	auto ms = [](clock::time_point t0) { return std::chrono::duration<double, std::milli>(clock::now() - t0).count(); };
+
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<uint32_t> model(0, 63), level(0, 5);
+	std::uniform_real_distribution<float> depth(0.0f, 1.0f);
+	RenderQueue queue;
+	queue.resize(count);
+	std::vector<size_t> lods(count);
+	std::vector<float> depths(count);
+	for (size_t i = 0; i < count; i++) {
+		queue.setObjectKey((uint32_t)i, 0, model(rng));
+		lods[i] = level(rng);
+		depths[i] = depth(rng);
+	}
+	auto fill = [&]() {
+		queue.clear();
+		for (size_t i = 0; i < count; i++)
+			queue.push((uint32_t)i, lods[i], depths[i]);
+	};
+
+	const int runs = 20;
+	double radixMs = 0.0, stdMs = 0.0, sortedMs = 0.0;
+	size_t mismatches = 0;
+	std::vector<RenderQueue::Packet> reference;
+	reference.reserve(count);
+	for (int r = 0; r < runs; r++) {
+		fill();
+		reference.assign(queue.getPackets().begin(), queue.getPackets().end());
+		auto t0 = clock::now();
+		queue.sort();
+		radixMs += ms(t0);
+		t0 = clock::now();
+		std::sort(reference.begin(), reference.end(),
+			[](const RenderQueue::Packet& a, const RenderQueue::Packet& b) { return a.key < b.key; });
+		stdMs += ms(t0);
+		for (size_t i = 0; i < count; i++)
+			mismatches += queue.getPackets()[i].key != reference[i].key;
+		t0 = clock::now();
+		queue.sort();  // already in order
+		sortedMs += ms(t0);
+	}
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << count << " packets: radix sort " << radixMs / runs << " ms (std::sort " << stdMs / runs
+		<< " ms), already sorted " << sortedMs / runs << " ms, " << mismatches << " mismatches" << std::endl;
+}
+
+// Load and unload meshes of random sizes through the arena's allocator, following its policy
+// (compact when no free range fits, grow when the free space falls short), and report how
+// often each happened and how fragmented the free space got in between
+static void arenaReport() {
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> logSize(std::log(100.0f), std::log(100000.0f));
+	const size_t cycles = 10000, resident = 64;
+	RangeAllocator space(1 << 20);
+	std::vector<std::pair<size_t, size_t>> live;  // (offset, size)
+	size_t compactions = 0, growths = 0, maxBlocks = 0;
+	double fragmentation = 0.0;
+	for (size_t c = 0; c < cycles; c++) {
+		// Unload a random mesh once enough are resident
+		if (live.size() >= resident) {
+			size_t k = rng() % live.size();
+			space.free(live[k].first, live[k].second);
+			live[k] = live.back();
+			live.pop_back();
+		}
+		size_t size = (size_t)std::exp(logSize(rng));
+		size_t offset = space.allocate(size);
+		if (offset == RangeAllocator::npos) {
+			size_t capacity = space.capacity();
+			while (capacity - space.used() < size)
+				capacity *= 2;
+			(capacity == space.capacity() ? compactions : growths)++;
+			// Compaction packs the live ranges in offset order
+			std::sort(live.begin(), live.end());
+			size_t top = 0;
+			for (auto& l : live) {
+				l.first = top;
+				top += l.second;
+			}
+			space.reset(capacity, top);
+			offset = space.allocate(size);
+		}
+		live.push_back(std::make_pair(offset, size));
+		maxBlocks = std::max(maxBlocks, space.freeBlocks());
+		size_t freeSpace = space.capacity() - space.used();
+		fragmentation += freeSpace ? 1.0 - (double)space.largestFree() / freeSpace : 0.0;
+	}
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << cycles << " loads of 100-100000 vertices, " << resident << " resident: capacity "
+		<< space.capacity() << " vertices, " << compactions << " compactions, " << growths << " growths" << std::endl;
+	std::cout << "free space: up to " << maxBlocks << " ranges, " << 100.0 * fragmentation / cycles
+		<< "% outside the largest on average" << std::endl;
+}
+
+// Scatter count static copies of the models in models/ over a ground plane, with random turns and
+// sizes, and time merging them into batches
+static void batchReport(size_t count) {
+	using clock = std::chrono::steady_clock;
+	auto ms = [](clock::time_point t0) { return std::chrono::duration<double, std::milli>(clock::now() - t0).count(); };
+
+	std::vector<Mesh::Geometry> models;
+	for (const fs::path& file : findModelFiles())
+		models.push_back(Mesh::readFile(file.string()));
+	if (models.empty())
+		throw std::runtime_error("No models in models/");
+
+	std::mt19937 rng(1234);
+	float side = 10.0f * std::sqrt((float)count);
+	std::uniform_real_distribution<float> ground(-0.5f * side, 0.5f * side), turn(0.0f, glm::two_pi<float>()), size(0.5f, 2.0f);
+	std::vector<StaticInstance> instances(count);
+	size_t vertices = 0;
+	for (size_t i = 0; i < count; i++) {
+		instances[i].geom = &models[rng() % models.size()];
+		glm::mat4 m = glm::translate(glm::mat4(1.0f), glm::vec3(ground(rng), 0.0f, ground(rng)));
+		m = glm::rotate(m, turn(rng), glm::vec3(0.0f, 1.0f, 0.0f));
+		instances[i].modelMat = glm::scale(m, glm::vec3(size(rng)));
+		vertices += instances[i].geom->vertices.size();
+	}
+
+	auto t0 = clock::now();
+	std::vector<Mesh::Geometry> batches = buildStaticBatches(instances);
+	double buildMs = ms(t0);
+	size_t largest = 0, triangles = 0;
+	for (const Mesh::Geometry& b : batches) {
+		largest = std::max(largest, b.vertices.size());
+		triangles += b.lods.empty() ? b.indices.size() / 3 : b.lods[0].count / 3;
+	}
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << count << " static objects (" << models.size() << " models, " << vertices << " vertices) -> "
+		<< batches.size() << " batches of up to " << largest << " vertices, " << triangles
+		<< " triangles at full detail" << std::endl;
+	std::cout << "built in " << buildMs << " ms on " << ThreadPool::instance().concurrency() << " threads" << std::endl;
+}
+
+// Every report, by flag. Those with a default count take an optional count after the flag.
+struct Report {
+	const char* flag;
+	size_t defaultCount;	// 0 if the report takes no count
+	std::function<void(size_t)> run;
+};
+
+static const Report reports[] = {
+	{ "--parse-report", 0, [](size_t) { parseReport(); } },
+	{ "--prewarm-cache", 0, [](size_t) { prewarmCache(); } },
+	{ "--quantize-report", 0, [](size_t) { quantizeReport(); } },
+	{ "--optimize-report", 0, [](size_t) { optimizeReport(); } },
+	{ "--lod-report", 0, [](size_t) { lodReport(); } },
+	{ "--bvh-report", 100000, bvhReport },
+	{ "--queue-report", 100000, queueReport },
+	{ "--arena-report", 0, [](size_t) { arenaReport(); } },
+	{ "--batch-report", 1000, batchReport },
+};
+
+// A positive count, or 0 if the argument is not one
+static size_t parseCount(const char* arg) {
+	if (!*arg || strspn(arg, "0123456789") != strlen(arg))
+		return 0;
+	return (size_t)strtoull(arg, nullptr, 10);
+}
+
+bool runReport(int argc, char** argv, int& exitCode) {
+	for (int i = 1; i < argc; i++) {
+		for (const Report& r : reports) {
+			if (strcmp(argv[i], r.flag) != 0)
+				continue;
+			size_t count = r.defaultCount;
+			if (count && i + 1 < argc && parseCount(argv[i + 1]))
+				count = parseCount(argv[i + 1]);
+			try {
+				r.run(count);
+				exitCode = 0;
+			} catch (const std::exception& e) {
+				std::cerr << "Fatal error: " << e.what() << std::endl;
+				exitCode = -1;
+			}
+			return true;
+		}
+	}
+	return false;
+}
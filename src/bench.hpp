@@ -0,0 +1,10 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+// Reports and tools that run from the command line instead of the viewer, each named by a
+// flag and some taking a count after it, e.g. "--bvh-report 50000" (see README.txt).
+// Runs the first one in the arguments; returns whether there was one, with the process exit
+// code in exitCode.
+bool runReport(int argc, char** argv, int& exitCode);
+
+#endif
@@ -0,0 +1,290 @@
+#define NOMINMAX
+#include "bvh.hpp"
+#include <algorithm>
+#include <numeric>
+#include <queue>
+#include <limits>
+#include <cmath>
+#include "threadpool.hpp"
+
+static const int binCount = 16;				// SAH bins per axis
+static const uint32_t maxLeafItems = 4;		// Larger nodes are always split
+static const float traversalCost = 1.0f;	// Cost of visiting a node, relative to testing an item
+static const uint32_t parallelItems = 4096;	// Larger subtrees build their two children in parallel
+static const int medianDepth = 64;			// Deeper nodes split at the median, bounding the depth
+static const int maxDepth = 128;			// Traversal stack size
+
+static inline float halfArea(glm::vec3 minBB, glm::vec3 maxBB) {
+	glm::vec3 d = glm::max(maxBB - minBB, glm::vec3(0.0f));
+	return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+// Squared distance from a point to a box (0 inside)
+static inline float boxDistance2(glm::vec3 p, glm::vec3 minBB, glm::vec3 maxBB) {
+	glm::vec3 d = glm::max(glm::max(minBB - p, p - maxBB), glm::vec3(0.0f));
+	return glm::dot(d, d);
+}
+
+Bvh::Bvh() : nodeTop(0) {}
+
+void Bvh::clear() {
+	nodes.clear();
+	items.clear();
+	itemMin.clear();
+	itemMax.clear();
+}
+
+void Bvh::build(const std::vector<glm::vec3>& minBBs, const std::vector<glm::vec3>& maxBBs) {
+	clear();
+	const size_t n = minBBs.size();
+	if (n == 0)
+		return;
+	items.resize(n);
+	std::iota(items.begin(), items.end(), 0u);
+	std::vector<glm::vec3> centers(n);
+	for (size_t i = 0; i < n; i++)
+		centers[i] = 0.5f * (minBBs[i] + maxBBs[i]);
+
+	// A binary tree with at most n leaves has at most 2n - 1 nodes. Children are claimed in
+	// pairs by whichever thread splits their parent.
+	nodes.resize(2 * n);
+	nodes[0].first = 0;
+	nodes[0].count = (uint32_t)n;
+	nodeTop = 1;
+	buildNode(0, 0, minBBs, maxBBs, centers);
+	nodes.resize(nodeTop);
+	nodes.shrink_to_fit();
+
+	// Copy the item boxes into leaf order so queries read them sequentially
+	itemMin.resize(n);
+	itemMax.resize(n);
+	for (size_t i = 0; i < n; i++) {
+		itemMin[i] = minBBs[items[i]];
+		itemMax[i] = maxBBs[items[i]];
+	}
+}
+
+void Bvh::buildNode(uint32_t index, int depth, const std::vector<glm::vec3>& minBBs,
+	const std::vector<glm::vec3>& maxBBs, const std::vector<glm::vec3>& centers) {
+	Node& node = nodes[index];
+	const uint32_t first = node.first, count = node.count;
+	uint32_t* begin = &items[first];
+	uint32_t* end = begin + count;
+
+	glm::vec3 cmin(std::numeric_limits<float>::max()), cmax(std::numeric_limits<float>::lowest());
+	node.minBB = glm::vec3(std::numeric_limits<float>::max());
+	node.maxBB = glm::vec3(std::numeric_limits<float>::lowest());
+	for (uint32_t* it = begin; it != end; ++it) {
+		node.minBB = glm::min(node.minBB, minBBs[*it]);
+		node.maxBB = glm::max(node.maxBB, maxBBs[*it]);
+		cmin = glm::min(cmin, centers[*it]);
+		cmax = glm::max(cmax, centers[*it]);
+	}
+	node.left = 0;
+	if (count <= 1)
+		return;
+
+	// Binned SAH: sweep the bin boundaries of every axis for the cheapest split
+	int bestAxis = -1, bestBin = 0;
+	float bestCost = std::numeric_limits<float>::max();
+	if (depth < medianDepth) {
+		for (int axis = 0; axis < 3; axis++) {
+			float extent = cmax[axis] - cmin[axis];
+			if (extent <= 0.0f)
+				continue;
+			float scale = binCount / extent;
+			uint32_t binItems[binCount] = {};
+			glm::vec3 binMin[binCount], binMax[binCount];
+			for (int b = 0; b < binCount; b++) {
+				binMin[b] = glm::vec3(std::numeric_limits<float>::max());
+				binMax[b] = glm::vec3(std::numeric_limits<float>::lowest());
+			}
+			for (uint32_t* it = begin; it != end; ++it) {
+				int b = std::min(binCount - 1, (int)((centers[*it][axis] - cmin[axis]) * scale));
+				binItems[b]++;
+				binMin[b] = glm::min(binMin[b], minBBs[*it]);
+				binMax[b] = glm::max(binMax[b], maxBBs[*it]);
+			}
+			// Right-to-left prefix areas, then a left-to-right sweep
+			float rightCost[binCount];
+			glm::vec3 rmin(std::numeric_limits<float>::max()), rmax(std::numeric_limits<float>::lowest());
+			uint32_t rcount = 0;
+			for (int b = binCount - 1; b > 0; b--) {
+				rmin = glm::min(rmin, binMin[b]);
+				rmax = glm::max(rmax, binMax[b]);
+				rcount += binItems[b];
+				rightCost[b] = rcount ? halfArea(rmin, rmax) * rcount : 0.0f;
+			}
+			glm::vec3 lmin(std::numeric_limits<float>::max()), lmax(std::numeric_limits<float>::lowest());
+			uint32_t lcount = 0;
+			for (int b = 0; b < binCount - 1; b++) {
+				lmin = glm::min(lmin, binMin[b]);
+				lmax = glm::max(lmax, binMax[b]);
+				lcount += binItems[b];
+				if (lcount == 0 || lcount == count)
+					continue;
+				float cost = halfArea(lmin, lmax) * lcount + rightCost[b + 1];
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = b;
+				}
+			}
+		}
+	}
+
+	// Small nodes stay leaves unless visiting two children is cheaper than testing every item
+	float area = halfArea(node.minBB, node.maxBB);
+	if (count <= maxLeafItems && (bestAxis < 0 || area <= 0.0f || traversalCost + bestCost / area >= count))
+		return;
+
+	uint32_t* mid;
+	if (bestAxis >= 0) {
+		float scale = binCount / (cmax[bestAxis] - cmin[bestAxis]);
+		mid = std::partition(begin, end, [&](uint32_t i) {
+			return std::min(binCount - 1, (int)((centers[i][bestAxis] - cmin[bestAxis]) * scale)) <= bestBin;
+		});
+	} else {
+		// All centers coincide, or the tree is too deep: split at the median of the widest axis
+		glm::vec3 extent = cmax - cmin;
+		int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+		mid = begin + count / 2;
+		std::nth_element(begin, mid, end, [&](uint32_t a, uint32_t b) { return centers[a][axis] < centers[b][axis]; });
+	}
+
+	uint32_t left = nodeTop.fetch_add(2);
+	node.left = left;
+	nodes[left].first = first;
+	nodes[left].count = (uint32_t)(mid - begin);
+	nodes[left + 1].first = first + nodes[left].count;
+	nodes[left + 1].count = count - nodes[left].count;
+	if (count > parallelItems) {
+		ThreadPool::instance().parallelFor(2, [&](size_t child) {
+			buildNode(left + (uint32_t)child, depth + 1, minBBs, maxBBs, centers);
+		});
+	} else {
+		buildNode(left, depth + 1, minBBs, maxBBs, centers);
+		buildNode(left + 1, depth + 1, minBBs, maxBBs, centers);
+	}
+}
+
+void Bvh::queryFrustum(const Frustum& frustum, std::vector<uint32_t>& out) const {
+	if (nodes.empty())
+		return;
+	uint32_t stack[maxDepth];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const Node& node = nodes[stack[--top]];
+		Frustum::Containment c = frustum.classify(node.minBB, node.maxBB);
+		if (c == Frustum::OUTSIDE)
+			continue;
+		if (c == Frustum::INSIDE) {
+			out.insert(out.end(), items.begin() + node.first, items.begin() + node.first + node.count);
+		} else if (node.left) {
+			stack[top++] = node.left + 1;
+			stack[top++] = node.left;
+		} else {
+			for (uint32_t i = node.first; i < node.first + node.count; i++) {
+				if (frustum.intersects(itemMin[i], itemMax[i]))
+					out.push_back(items[i]);
+			}
+		}
+	}
+}
+
+void Bvh::queryOverlap(glm::vec3 minBB, glm::vec3 maxBB, std::vector<uint32_t>& out) const {
+	if (nodes.empty())
+		return;
+	auto overlaps = [&](glm::vec3 a, glm::vec3 b) {
+		return glm::all(glm::lessThanEqual(a, maxBB)) && glm::all(glm::lessThanEqual(minBB, b));
+	};
+	uint32_t stack[maxDepth];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const Node& node = nodes[stack[--top]];
+		if (!overlaps(node.minBB, node.maxBB))
+			continue;
+		if (node.left) {
+			stack[top++] = node.left + 1;
+			stack[top++] = node.left;
+		} else {
+			for (uint32_t i = node.first; i < node.first + node.count; i++) {
+				if (overlaps(itemMin[i], itemMax[i]))
+					out.push_back(items[i]);
+			}
+		}
+	}
+}
+
+void Bvh::queryRay(glm::vec3 origin, glm::vec3 dir, float tMax, std::vector<std::pair<float, uint32_t>>& out) const {
+	if (nodes.empty())
+		return;
+	const glm::vec3 invDir = 1.0f / dir;  // infinities for axis-parallel rays work with the slab test
+	// Entry distance of the ray into a box, or a negative value on a miss
+	auto enter = [&](glm::vec3 a, glm::vec3 b) {
+		glm::vec3 t0 = (a - origin) * invDir, t1 = (b - origin) * invDir;
+		glm::vec3 tn = glm::min(t0, t1), tf = glm::max(t0, t1);
+		float tEnter = std::max(std::max(tn.x, tn.y), std::max(tn.z, 0.0f));
+		float tExit = std::min(std::min(tf.x, tf.y), std::min(tf.z, tMax));
+		return tEnter <= tExit ? tEnter : -1.0f;
+	};
+	size_t start = out.size();
+	uint32_t stack[maxDepth];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const Node& node = nodes[stack[--top]];
+		if (enter(node.minBB, node.maxBB) < 0.0f)
+			continue;
+		if (node.left) {
+			stack[top++] = node.left + 1;
+			stack[top++] = node.left;
+		} else {
+			for (uint32_t i = node.first; i < node.first + node.count; i++) {
+				float t = enter(itemMin[i], itemMax[i]);
+				if (t >= 0.0f && t < tMax)
+					out.push_back(std::make_pair(t, items[i]));
+			}
+		}
+	}
+	std::sort(out.begin() + start, out.end());
+}
+
+void Bvh::queryNearest(glm::vec3 point, size_t k, std::vector<std::pair<float, uint32_t>>& out) const {
+	if (nodes.empty() || k == 0)
+		return;
+	// Best-first over nodes by distance, keeping the k best items in a max-heap
+	typedef std::pair<float, uint32_t> Entry;
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+	std::priority_queue<Entry> best;
+	open.push(Entry(boxDistance2(point, nodes[0].minBB, nodes[0].maxBB), 0));
+	while (!open.empty()) {
+		Entry e = open.top();
+		open.pop();
+		if (best.size() == k && e.first > best.top().first)
+			break;  // every remaining node is farther than the k-th item
+		const Node& node = nodes[e.second];
+		if (node.left) {
+			for (uint32_t c = node.left; c <= node.left + 1; c++)
+				open.push(Entry(boxDistance2(point, nodes[c].minBB, nodes[c].maxBB), c));
+		} else {
+			for (uint32_t i = node.first; i < node.first + node.count; i++) {
+				float d = boxDistance2(point, itemMin[i], itemMax[i]);
+				if (best.size() < k) {
+					best.push(Entry(d, items[i]));
+				} else if (d < best.top().first) {
+					best.pop();
+					best.push(Entry(d, items[i]));
+				}
+			}
+		}
+	}
+	size_t start = out.size();
+	while (!best.empty()) {
+		out.push_back(Entry(std::sqrt(best.top().first), best.top().second));
+		best.pop();
+	}
+	std::reverse(out.begin() + start, out.end());
+}
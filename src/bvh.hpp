@@ -0,0 +1,60 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <atomic>
+#include <glm/glm.hpp>
+#include "frustum.hpp"
+
+// Bounding volume hierarchy over a set of axis-aligned boxes (e.g. scene object bounds).
+// Items are referred to by their index in the arrays passed to build().
+class Bvh {
+public:
+	Bvh();
+	// Disallow copy, move, & assignment
+	Bvh(const Bvh& other) = delete;
+	Bvh& operator=(const Bvh& other) = delete;
+	Bvh(Bvh&& other) = delete;
+	Bvh& operator=(Bvh&& other) = delete;
+
+	// Build with the binned surface area heuristic. Large subtrees are built in parallel on
+	// the thread pool. Replaces any previous hierarchy.
+	void build(const std::vector<glm::vec3>& minBBs, const std::vector<glm::vec3>& maxBBs);
+	void clear();
+
+	// queries (results are appended to out):
+	// Items whose box may be visible in the frustum
+	void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& out) const;
+	// Items whose box overlaps the given box
+	void queryOverlap(glm::vec3 minBB, glm::vec3 maxBB, std::vector<uint32_t>& out) const;
+	// Items whose box the ray enters within [0, tMax), nearest entry first, with the entry distance
+	void queryRay(glm::vec3 origin, glm::vec3 dir, float tMax, std::vector<std::pair<float, uint32_t>>& out) const;
+	// The k items whose boxes are closest to a point, nearest first, with the distance
+	void queryNearest(glm::vec3 point, size_t k, std::vector<std::pair<float, uint32_t>>& out) const;
+
+	// access:
+	inline size_t size() const { return items.size(); }
+	inline size_t nodeCount() const { return nodes.size(); }
+
+protected:
+	struct Node {
+		glm::vec3 minBB;
+		uint32_t first;		// First entry of items in this subtree
+		glm::vec3 maxBB;
+		uint32_t count;		// Number of items in this subtree
+		uint32_t left;		// Index of the left child (the right one follows it), 0 for leaves
+	};
+
+	void buildNode(uint32_t index, int depth, const std::vector<glm::vec3>& minBBs,
+		const std::vector<glm::vec3>& maxBBs, const std::vector<glm::vec3>& centers);
+
+	std::vector<Node> nodes;			// nodes[0] is the root
+	std::vector<uint32_t> items;		// Item indices, each subtree's contiguous
+	std::vector<glm::vec3> itemMin;		// Item boxes, in the order of items
+	std::vector<glm::vec3> itemMax;
+	std::atomic<uint32_t> nodeTop;		// Nodes allocated so far (during build)
+};
+
+#endif
@@ -12,7 +12,9 @@ Camera::Camera(const CameraType cType) :
 	camType(cType),
 	width(1), height(1),
 	fovy(45.0f),
-	camCoords(0.0f, 0.0f, 10.0f)
+	camCoords(0.0f, 0.0f, 10.0f),
+	dirty(true),
+	revision(0)
 	{}
 
 // constructor
@@ -22,9 +24,10 @@ Camera::Camera(const glm::vec3 eye, const glm::vec3 center, const glm::vec3 up,
 	camUp(up),
 	camType(cType),
 	width(1), height(1),
-	fovy(45.0f) {
-	updateViewProj();
-}
+	fovy(45.0f),
+	dirty(true),
+	revision(0)
+	{}
 
 void Camera::updateViewProj() {
 	float aspect = (float)width / (float)height;
@@ -36,13 +39,25 @@ void Camera::updateViewProj() {
 	// 1. implement "Camera::calCameraMat" which returns the "view" matrix; it has arguments: "camCoords", "camCenter" and "camUp".
 	// 2. REMOVE the line below, and replace that by calling your own function for computing "view": view = calCameraMat(..., ..., ...);
 	//view = glm::lookAt(camCoords, camCenter, camUp);  //  should NOT be used in this assignment
-	view = calCameraMat(camCoords, camCenter, camUp);
+	if (camType == OVERHEAD_VIEW) {
+		// Trackball: camCoords holds the yaw and pitch in degrees and the distance from the origin
+		view = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -camCoords.z));
+		view = glm::rotate(view, glm::radians(camCoords.y), glm::vec3(1.0f, 0.0f, 0.0f));
+		view = glm::rotate(view, glm::radians(camCoords.x), glm::vec3(0.0f, 1.0f, 0.0f));
+		eyePos = glm::vec3(glm::inverse(view)[3]);
+	} else {
+		view = calCameraMat(camCoords, camCenter, camUp);
+		eyePos = camCoords;
+	}
 
 	if (camType == GROUND_VIEW || camType == OVERHEAD_VIEW) {  // perspective projection
-		proj = glm::perspective(glm::radians(fovy), aspect, 0.1f, 100.0f);
+		proj = glm::perspective(glm::radians(fovy), aspect, zNear, zFar);
 	}
 	else  // orthographic projection
 		proj = glm::ortho(-15.0f, 15.0f, -15.0f, 15.0f, 0.1f, 100.0f);
+	viewProj = proj * view;  // opengl does matrix multiplication from right to left
+	dirty = false;
+	revision++;
 }
 
 glm::mat4 Camera::calCameraMat(const glm::vec3 eye, const glm::vec3 center, const glm::vec3 up) {  // calculate the camera view matrix
@@ -155,7 +170,7 @@ void Camera::turnLeft() {
 	camCenter.x = center_4.x;
 	camCenter.y = center_4.y;
 	camCenter.z = center_4.z;
-	updateViewProj();  // update view
+	dirty = true;  // update view
 }
 
 void Camera::turnRight() {
@@ -172,7 +187,7 @@ void Camera::turnRight() {
 	camCenter.x = center_4.x;
 	camCenter.y = center_4.y;
 	camCenter.z = center_4.z;
-	updateViewProj();  // update view
+	dirty = true;  // update view
 }
 
 void Camera::moveForward() {
@@ -192,7 +207,7 @@ void Camera::moveForward() {
 	}
 	else
 		return;
-	updateViewProj();  // update view
+	dirty = true;  // update view
 }
 
 void Camera::moveBackward() {
@@ -211,7 +226,7 @@ void Camera::moveBackward() {
 	}
 	else
 		return;
-	updateViewProj();
+	dirty = true;
 }
 
 void Camera::moveUp() {
@@ -224,7 +239,7 @@ void Camera::moveUp() {
 		temp = translation * glm::vec4(camCenter, 1.0);
 		camCenter.x = temp.x / temp.w; camCenter.y = temp.y / temp.w; camCenter.z = temp.z / temp.w;  // normalize
 	}
-	updateViewProj();
+	dirty = true;
 }
 
 void Camera::moveDown() {
@@ -237,5 +252,5 @@ void Camera::moveDown() {
 		temp = translation * glm::vec4(camCenter, 1.0);
 		camCenter.x = temp.x / temp.w; camCenter.y = temp.y / temp.w; camCenter.z = temp.z / temp.w;  // normalize
 	}
-	updateViewProj();
+	dirty = true;
 }
@@ -31,19 +31,27 @@ public:
 	inline void setWH(const int w, const int h) {  // update width and height
 		width = w;
 		height = h;
-		updateViewProj();
+		dirty = true;
 	}
 	inline int getW() { return width; }
 	inline int getH() { return height; }
 	inline float getFovy() { return fovy; }
+	inline float getNear() const { return zNear; }
+	inline float getFar() const { return zFar; }
 	inline glm::vec3 getCoords() { return camCoords; }
 	void setCoords(const GLfloat x, const GLfloat y, const GLfloat z) {
 		camCoords.x = x;
 		camCoords.y = y;
 		camCoords.z = z;
+		dirty = true;
 	}
-	inline glm::mat4 getView() { return view; }
-	inline glm::mat4 getProj() { return proj; }
+	// Matrices are recomputed on first use after the camera changes
+	inline const glm::mat4& getView() { if (dirty) updateViewProj(); return view; }
+	inline const glm::mat4& getProj() { if (dirty) updateViewProj(); return proj; }
+	inline const glm::mat4& getViewProj() { if (dirty) updateViewProj(); return viewProj; }
+	inline glm::vec3 getPosition() { if (dirty) updateViewProj(); return eyePos; }  // world-space eye
+	// Incremented every time the matrices are recomputed, so users can tell when they changed
+	inline unsigned getRevision() { if (dirty) updateViewProj(); return revision; }
 
 protected:
 	// Camera state
@@ -54,11 +62,16 @@ protected:
 	glm::vec3 camCenter;		// the position the camera is looking at; used in glm::lookAt()
 	glm::vec3 camUp;			// up vector; used in glm::lookAt()
 	glm::mat4 view, proj;		// view and projection matrices
+	glm::mat4 viewProj;			// proj * view
+	glm::vec3 eyePos;			// World-space camera position
+	bool dirty;					// Whether the matrices are out of date
+	unsigned revision;			// Number of times the matrices were computed
 
+	float zNear = 0.1f, zFar = 100.0f;  // clipping planes of the perspective projection
 	GLfloat rotStep = 2.0f;   // rotation step
 	GLfloat moveStep = 0.2f;  // moving step
 
-	void updateViewProj();  // update view and projection matrices whenever they change
+	void updateViewProj();  // update view and projection matrices (on first use after a change)
 	glm::mat4 calCameraMat(const glm::vec3 eye, const glm::vec3 center, const glm::vec3 up);  // calculate the camera view matrix
 	// computations:
 	glm::mat4 rotate(const float degree, const glm::vec3 axis);
@@ -0,0 +1,54 @@
+#include "frustum.hpp"
+
+void transformBox(const glm::mat4& mat, glm::vec3 minBB, glm::vec3 maxBB, glm::vec3& outMin, glm::vec3& outMax) {
+	// Per axis, each matrix column adds its smaller product to the min and its larger to the max
+	glm::vec3 translation(mat[3]);
+	outMin = translation;
+	outMax = translation;
+	for (int i = 0; i < 3; i++) {
+		glm::vec3 a = glm::vec3(mat[i]) * minBB[i];
+		glm::vec3 b = glm::vec3(mat[i]) * maxBB[i];
+		outMin += glm::min(a, b);
+		outMax += glm::max(a, b);
+	}
+}
+
+Frustum::Frustum(const glm::mat4& viewProj) {
+	// Gribb & Hartmann: each plane is the last row of the matrix plus or minus another row
+	glm::vec4 row[4];
+	for (int i = 0; i < 4; i++)
+		row[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+	planes[0] = row[3] + row[0];
+	planes[1] = row[3] - row[0];
+	planes[2] = row[3] + row[1];
+	planes[3] = row[3] - row[1];
+	planes[4] = row[3] + row[2];
+	planes[5] = row[3] - row[2];
+	for (auto& p : planes)
+		p /= glm::length(glm::vec3(p));
+}
+
+bool Frustum::intersects(glm::vec3 minBB, glm::vec3 maxBB) const {
+	for (const auto& p : planes) {
+		// Corner of the box farthest along the plane normal
+		glm::vec3 corner(p.x >= 0.0f ? maxBB.x : minBB.x, p.y >= 0.0f ? maxBB.y : minBB.y, p.z >= 0.0f ? maxBB.z : minBB.z);
+		if (glm::dot(glm::vec3(p), corner) + p.w < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+Frustum::Containment Frustum::classify(glm::vec3 minBB, glm::vec3 maxBB) const {
+	Containment result = INSIDE;
+	for (const auto& p : planes) {
+		glm::vec3 n(p);
+		glm::vec3 far(p.x >= 0.0f ? maxBB.x : minBB.x, p.y >= 0.0f ? maxBB.y : minBB.y, p.z >= 0.0f ? maxBB.z : minBB.z);
+		if (glm::dot(n, far) + p.w < 0.0f)
+			return OUTSIDE;
+		// Corner of the box nearest to the outside of the plane
+		glm::vec3 near(p.x >= 0.0f ? minBB.x : maxBB.x, p.y >= 0.0f ? minBB.y : maxBB.y, p.z >= 0.0f ? minBB.z : maxBB.z);
+		if (glm::dot(n, near) + p.w < 0.0f)
+			result = PARTIAL;
+	}
+	return result;
+}
@@ -0,0 +1,28 @@
+#ifndef FRUSTUM_HPP
+#define FRUSTUM_HPP
+
+#include <glm/glm.hpp>
+
+// Axis-aligned box enclosing a model-space box after a transform (e.g. the model matrix)
+void transformBox(const glm::mat4& mat, glm::vec3 minBB, glm::vec3 maxBB, glm::vec3& outMin, glm::vec3& outMax);
+
+// The six planes bounding what a camera sees, in the space its matrix transforms from
+class Frustum {
+public:
+	Frustum() {}
+	// Extract the planes from a projection * view matrix (world-space planes)
+	explicit Frustum(const glm::mat4& viewProj);
+
+	// Whether any part of an axis-aligned box may be visible. Boxes near a corner of the
+	// frustum can pass without being visible; no visible box is ever rejected.
+	bool intersects(glm::vec3 minBB, glm::vec3 maxBB) const;
+
+	enum Containment { OUTSIDE, PARTIAL, INSIDE };
+	// Like intersects, but also tells apart boxes entirely inside the frustum
+	Containment classify(glm::vec3 minBB, glm::vec3 maxBB) const;
+
+protected:
+	glm::vec4 planes[6];	// (normal, offset) with the normal pointing inside: left, right, bottom, top, near, far
+};
+
+#endif
@@ -1,18 +1,57 @@
 #define NOMINMAX
 #include <iostream>
+#include <algorithm>
+#include <cstring>
 #include "glstate.hpp"
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include "util.hpp"
+#include "frustum.hpp"
+#include "programcache.hpp"
+
+// Uniform buffer binding points of the blocks in the vertex shaders
+static const GLuint frameBinding = 0;
+static const GLuint objectBinding = 1;
+
+// Frames of instance transforms the stream ring holds, and its largest size
+static const size_t streamFrames = 3;
+static const size_t maxStreamBytes = 12 << 20;
+
+// Uniforms of the instanced programs, in the order given to setUniforms()
+static const size_t instanceBaseUniform = 0;	// First instance entry of the draw
+static const size_t octScaleUniform = 1;		// Normal decoding factor
+
+// Meshes the loader hands over per frame at most, to spread the work of a large scene
+static const size_t loadResultsPerFrame = 4;
+
+// Milliseconds since a time point
+static double msSince(std::chrono::steady_clock::time_point t0) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
 
 // Constructor
 GLState::GLState() :  // initialize all variables
-	shader(0),
-	xformLoc(0),
-	vao(0),
-	vbuf(0),
-	ibuf(0),
-	vcount(0),
+	vertexFormat(Mesh::VERTEX_FLOAT),
+	instancing(true),
+	staticBatching(true),
+	asyncLoading(true),
+	shaderCache(true),
+	viewportHeight(1),
+	showNormals(false),
+	loadFrames(0),
+	longestFrameMs(0.0),
+	longestIntegrateMs(0.0),
+	integrateMs(0.0),
+	instTex(0),
+	maxInstances(0),
+	frameUbo(0),
+	objectUbo(0),
+	objectStride(0),
+	frameCamera(nullptr),
+	frameRevision(0),
+	visibleCount(0),
+	culledCount(0),
+	drawCalls(0),
 	cam_ground(
 		glm::vec3(0.0, 1.5, 20.0),	// eye (position of the camera)
 		glm::vec3(0.0, 0.0, 0.0),	// center (the point the camera is looking at)
@@ -28,10 +67,9 @@ GLState::GLState() :  // initialize all variables
 // Destructor
 GLState::~GLState() {
 	// Release OpenGL resources
-	if (shader)	glDeleteProgram(shader);
-	if (vao)	glDeleteVertexArrays(1, &vao);
-	if (vbuf)	glDeleteBuffers(1, &vbuf);
-	if (ibuf)	glDeleteBuffers(1, &ibuf);
+	if (instTex)	glDeleteTextures(1, &instTex);
+	if (frameUbo)	glDeleteBuffers(1, &frameUbo);
+	if (objectUbo)	glDeleteBuffers(1, &objectUbo);
 }
 
 // Called when OpenGL context is created (some time after construction)
@@ -43,6 +81,8 @@ void GLState::initializeGL() {
 
 	// Initialize OpenGL state
 	initShaders();
+	if (asyncLoading)
+		loader = std::unique_ptr<AssetLoader>(new AssetLoader());
 	showScene();  // start
 }
 
@@ -51,67 +91,384 @@ void GLState::paintGL() {
 	// Clear the color and depth buffers
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	// Set shader to draw with
-	glUseProgram(shader);
-
-	// Construct a transformation matrix for the camera
-	glm::mat4 xform(1.0f), proj, view;
-
-	auto objects = scene->getSceneObjects();  // get all objects to render in the scene
-	for (auto& meshObj : objects) {
-		glm::mat4 modelMat = meshObj->getModelMat();
-		proj = (whichCam == GROUND_VIEW) ? cam_ground.getProj() : cam_overhead.getProj();
-		view = (whichCam == GROUND_VIEW) ? cam_ground.getView() : cam_overhead.getView();
-		xform = proj * view * modelMat;  // opengl does matrix multiplication from right to left
-
-		glm::mat4 viewProjMat(1.0f);
-		if (getCamType() == OVERHEAD_VIEW) {  // only the overhead view supports the trackball feature
-			// Perspective projection
-			float aspect = (float)(cam_overhead.getW()) / (float)(cam_overhead.getH());  // aspect ratio
-			glm::mat4 proj = glm::perspective(glm::radians(cam_overhead.getFovy()), aspect, 0.1f, 100.0f);  // projection matrix
-			// Camera viewpoint
-			glm::mat4 view = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -cam_overhead.getCoords().z));  // camera view matrix
-			view = glm::rotate(view, glm::radians(cam_overhead.getCoords().y), glm::vec3(1.0f, 0.0f, 0.0f));
-			view = glm::rotate(view, glm::radians(cam_overhead.getCoords().x), glm::vec3(0.0f, 1.0f, 0.0f));
-			// Combine transformations
-			viewProjMat = proj * view;
-			xform = viewProjMat * modelMat;
+	// Draw whatever has arrived so far
+	if (isLoading())
+		updateLoading();
+	if (shadersPending())
+		pollShaders();
+
+	// The camera caches its matrices; they only reach the GPU when they change
+	Camera& cam = getCamera(whichCam);
+	updateFrameConstants(cam);
+	const glm::mat4& view = cam.getView();
+	float fovy = cam.getFovy();
+	Frustum frustum(cam.getViewProj());
+
+	const std::vector<SceneObject>& objects = scene->getSceneObjects();  // get all objects to render in the scene
+	GeometryRegistry& geometry = scene->getGeometry();
+	// Find the objects not entirely outside the view
+	visibleObjects.clear();
+	scene->getBvh().queryFrustum(frustum, visibleObjects);
+	visibleCount = visibleObjects.size();
+	culledCount = objects.size() - visibleCount;
+
+	// Queue them by program, model, and level of detail, then front to back
+	queue.clear();
+	for (uint32_t i : visibleObjects) {
+		const SceneObject& obj = objects[i];
+		glm::vec3 center = 0.5f * (obj.minBB + obj.maxBB);
+		float depth = -(view * glm::vec4(center, 1.0f)).z / cam.getFar();
+		queue.push(i, selectLod(geometry.get(obj.geometry), obj.modelMat, view, fovy, (float)viewportHeight), depth);
+	}
+	queue.sort();
+
+	if (instancing)
+		drawInstances(objects);
+	else
+		drawObjects(objects);
+}
+
+void GLState::updateFrameConstants(Camera& cam) {
+	if (&cam == frameCamera && cam.getRevision() == frameRevision)
+		return;
+	FrameConstants frame;
+	frame.view = cam.getView();
+	frame.proj = cam.getProj();
+	frame.viewProj = cam.getViewProj();
+	frame.cameraPos = glm::vec4(cam.getPosition(), 1.0f);
+	glBindBuffer(GL_UNIFORM_BUFFER, frameUbo);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(frame), &frame);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	frameCamera = &cam;
+	frameRevision = cam.getRevision();
+}
+
+// Scene objects do not move, so their constants are written once, each at its own aligned
+// offset. Drawing an object then only binds its range of the buffer.
+void GLState::uploadObjectConstants() {
+	const std::vector<SceneObject>& objects = scene->getSceneObjects();
+	GeometryRegistry& geometry = scene->getGeometry();
+	std::vector<unsigned char> staging(std::max<size_t>(objects.size(), 1) * objectStride);
+	objectMats.resize(objects.size());
+	for (size_t i = 0; i < objects.size(); i++) {
+		const Mesh& mesh = geometry.get(objects[i].geometry);
+		objectMats[i] = objects[i].modelMat * mesh.positionTransform();  // quantized positions to world
+		ObjectConstants c;
+		c.model = objectMats[i];
+		c.params = glm::vec4(mesh.octNormalScale(), 0.0f, 0.0f, 0.0f);
+		memcpy(&staging[i * objectStride], &c, sizeof(c));
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, objectUbo);
+	glBufferData(GL_UNIFORM_BUFFER, staging.size(), staging.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// The variant of the program for objects with the given features, or the fallback program
+// while it compiles
+GLuint GLState::objectProgram(uint32_t features) {
+	ShaderProgram& program = shaders.get(features);
+	return program.isReady() ? program.id() : fallbackShader.id();
+}
+
+// Draw each queued object with its own draw call
+void GLState::drawObjects(const std::vector<SceneObject>& objects) {
+	GeometryRegistry& geometry = scene->getGeometry();
+	arena->bind();  // one vertex array for every object
+	uint64_t features = ~0ull;
+	for (const RenderQueue::Packet& p : queue.getPackets()) {
+		// The queue is sorted by program, so it changes a few times per frame at most
+		if ((p.key >> RenderQueue::programShift) != features) {
+			features = p.key >> RenderQueue::programShift;
+			glUseProgram(objectProgram((uint32_t)features));
 		}
+		Mesh& mesh = geometry.get(objects[p.object].geometry);
+		glBindBufferRange(GL_UNIFORM_BUFFER, objectBinding, objectUbo, p.object * objectStride, sizeof(ObjectConstants));
+		// Draw the mesh at the level of detail its size on screen calls for
+		mesh.draw((size_t)((p.key >> RenderQueue::lodShift) & 0xff));
+	}
+	drawCalls = queue.getPackets().size();
+	glBindVertexArray(0);
+	glUseProgram(0);
+}
+
+// Draw each run of packets with the same model and level of detail with one instanced call.
+// The transforms of all instances are uploaded together into a texture buffer, in as many
+// chunks as its size limit requires.
+void GLState::drawInstances(const std::vector<SceneObject>& objects) {
+	GeometryRegistry& geometry = scene->getGeometry();
+	const std::vector<RenderQueue::Packet>& packets = queue.getPackets();
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_BUFFER, instTex);
+	arena->bind();
+
+	drawCalls = 0;
+	GLuint current = 0;
+	GLint baseLoc = -1, octScaleLoc = -1;
+	for (size_t chunk = 0; chunk < packets.size(); chunk += maxInstances) {
+		const size_t end = std::min(packets.size(), chunk + maxInstances);
+		instanceMats.resize(end - chunk);  // within the capacity reserved for the scene
+		for (size_t i = chunk; i < end; i++)
+			instanceMats[i - chunk] = objectMats[packets[i].object];
+		// Into space of the ring the GPU is done with; the texture buffer spans the whole ring
+		size_t offset = instStream->write(instanceMats.data(), instanceMats.size() * sizeof(glm::mat4), sizeof(glm::mat4));
+		const size_t base = offset / sizeof(glm::mat4);
 
-		glUniformMatrix4fv(xformLoc, 1, GL_FALSE, glm::value_ptr(xform));
-		// Draw the mesh
-		meshObj->draw();
+		for (size_t first = chunk; first < end;) {
+			const uint64_t state = packets[first].key >> RenderQueue::stateShift;
+			size_t last = first + 1;
+			while (last < end && (packets[last].key >> RenderQueue::stateShift) == state)
+				last++;
+			Mesh& mesh = geometry.get(objects[packets[first].object].geometry);
+			ShaderProgram& program = instShaders.get((uint32_t)(state >> (RenderQueue::programShift - RenderQueue::stateShift)));
+			if (program.isReady()) {
+				if (program.id() != current) {
+					current = program.id();
+					glUseProgram(current);
+					baseLoc = program.location(instanceBaseUniform);
+					octScaleLoc = program.location(octScaleUniform);
+				}
+				glUniform1i(baseLoc, (GLint)(base + first - chunk));
+				glUniform1f(octScaleLoc, mesh.octNormalScale());
+				mesh.drawInstanced((size_t)(state & 0xff), (GLsizei)(last - first));
+				drawCalls++;
+			} else {
+				// Until the variant is ready, its objects are drawn one by one with the fallback
+				if (current != fallbackShader.id()) {
+					current = fallbackShader.id();
+					glUseProgram(current);
+				}
+				for (size_t i = first; i < last; i++) {
+					glBindBufferRange(GL_UNIFORM_BUFFER, objectBinding, objectUbo, packets[i].object * objectStride, sizeof(ObjectConstants));
+					mesh.draw((size_t)(state & 0xff));
+					drawCalls++;
+				}
+			}
+			first = last;
+		}
 	}
 
+	instStream->endFrame();
+
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
 	glUseProgram(0);
 }
 
+// Pick the level of detail of an object from how many pixels a model unit covers at its
+// nearest point to the camera
+size_t GLState::selectLod(const Mesh& mesh, const glm::mat4& modelMat, const glm::mat4& view, float fovy, float height) {
+	if (mesh.getLods().size() < 2)
+		return 0;
+	std::pair<glm::vec3, glm::vec3> bb = mesh.boundingBox();
+	glm::vec3 center = 0.5f * (bb.first + bb.second);
+	float scale = glm::max(glm::length(glm::vec3(modelMat[0])),
+		glm::max(glm::length(glm::vec3(modelMat[1])), glm::length(glm::vec3(modelMat[2]))));
+	float radius = 0.5f * glm::length(bb.second - bb.first) * scale;
+	glm::vec3 viewCenter = glm::vec3(view * modelMat * glm::vec4(center, 1.0f));
+	float dist = glm::length(viewCenter) - radius;
+	if (dist <= 0.1f)
+		return 0;  // the camera is inside or right next to it
+	// The viewport height spans 2 * dist * tan(fovy / 2) world units at that distance
+	float pixelsPerUnit = scale * height / (2.0f * dist * glm::tan(glm::radians(fovy) * 0.5f));
+	return mesh.selectLod(pixelsPerUnit);
+}
+
 // Called when window is resized
 void GLState::resizeGL(int w, int h) {
 	// Tell OpenGL the new dimensions of the window
 	cam_ground.setWH(w, h);
 	glViewport(0, 0, w, h);
+	viewportHeight = h;  // whichever camera is active
 }
 
 void GLState::showScene() {
+	// All scene meshes share the arena's buffers and vertex array. The old scene returns its
+	// space first, and the arena is compacted so the new one loads without fragmentation.
+	Clock::time_point t0 = Clock::now();
+	scene.reset();
+	if (arena && arena->vertexFormat() != vertexFormat)
+		arena.reset();
+	if (!arena)
+		arena = std::unique_ptr<GeometryArena>(new GeometryArena(vertexFormat));
+	else
+		arena->compact();
 	scene = std::unique_ptr<Scene>(new Scene());
-	scene->parseScene();  // read the scene file and load the meshes of the objects
+	if (loader) {
+		// The objects appear as the loader thread delivers their meshes
+		scene->beginLoad(*loader, vertexFormat, staticBatching);
+		loadStart = frameStart = Clock::now();
+		loadFrames = 0;
+		longestFrameMs = longestIntegrateMs = integrateMs = 0.0;
+	} else {
+		scene->parseScene(vertexFormat, arena.get(), staticBatching);  // read the scene file and load the meshes of the objects
+		std::cout << "Loaded the scene in " << msSince(t0) << " ms, drawing nothing meanwhile" << std::endl;
+		if (scene->getBatchedCount())
+			std::cout << "Merged " << scene->getBatchedCount() << " static objects into " << scene->getBatchCount() << " batches" << std::endl;
+	}
+	prepareScene();
+}
+
+void GLState::prepareScene() {
+	uploadObjectConstants();
+
+	// Reserve the per-frame storage for the new scene, and give every object its retained
+	// sort key. Drawing frames of an unchanged scene then allocates nothing.
+	const std::vector<SceneObject>& objects = scene->getSceneObjects();
+	visibleObjects.clear();
+	visibleObjects.reserve(objects.size());
+	instanceMats.clear();
+	instanceMats.reserve(std::min(objects.size(), maxInstances));
+	queue.resize(objects.size());
+	GeometryRegistry& geometry = scene->getGeometry();
+	for (size_t i = 0; i < objects.size(); i++) {
+		// The program variant is the fewest features the mesh's vertices need; it is compiled
+		// when first drawn with
+		const Mesh& mesh = geometry.get(objects[i].geometry);
+		uint32_t features = ShaderPermutations::featuresFor(mesh.vertexFormat(), showNormals);
+		queue.setObjectKey((uint32_t)i, features, objects[i].geometry);
+	}
+}
+
+// Finished meshes are taken over with GPU copies into the arena, a few per frame. The time
+// between frames meanwhile shows whether loading still holds up rendering.
+void GLState::updateLoading() {
+	Clock::time_point now = Clock::now();
+	longestFrameMs = std::max(longestFrameMs, std::chrono::duration<double, std::milli>(now - frameStart).count());
+	frameStart = now;
+	loadFrames++;
+
+	if (scene->update(*loader, arena.get(), loadResultsPerFrame))
+		prepareScene();
+	double ms = msSince(now);
+	longestIntegrateMs = std::max(longestIntegrateMs, ms);
+	integrateMs += ms;
+
+	if (!scene->isLoading()) {
+		std::cout << "Loaded the scene in the background in " << msSince(loadStart) << " ms ("
+			<< scene->getSceneObjects().size() << " objects, " << scene->getGeometry().size() << " meshes"
+			<< (loader->hasSharedContext() ? "" : ", uploaded on the render thread") << ")" << std::endl;
+		std::cout << "  " << loadFrames << " frames drawn meanwhile; longest frame " << longestFrameMs
+			<< " ms, longest hand-over " << longestIntegrateMs << " ms (" << integrateMs << " ms in all)" << std::endl;
+		if (scene->getBatchedCount())
+			std::cout << "Merged " << scene->getBatchedCount() << " static objects into " << scene->getBatchCount() << " batches" << std::endl;
+	}
 }
 
 // Create shaders and associated state
 void GLState::initShaders() {
-	// Compile and link shader files
-	std::vector<GLuint> shaders;
-	shaders.push_back(compileShader(GL_VERTEX_SHADER, "shaders/v.glsl"));
-	shaders.push_back(compileShader(GL_FRAGMENT_SHADER, "shaders/f.glsl"));
-	shader = linkProgram(shaders);
-	// Cleanup extra state
-	for (auto s : shaders)
-		glDeleteShader(s);
-	shaders.clear();
-
-	// Get uniform locations
-	xformLoc = glGetUniformLocation(shader, "xform");
+	// The programs are submitted together and compiled while frames are drawn, with the
+	// fallback program standing in until they are ready (see pollShaders()). The uniform
+	// blocks are connected to their binding points again after every link, so the programs
+	// can be rebuilt when the files change.
+	const std::string cacheDir = shaderCache ? "shaders" : "";
+	auto bindBlocks = [](GLuint program) {
+		glUniformBlockBinding(program, glGetUniformBlockIndex(program, "FrameConstants"), frameBinding);
+		glUniformBlockBinding(program, glGetUniformBlockIndex(program, "ObjectConstants"), objectBinding);
+	};
+
+	// The fallback is tiny, so waiting for it does not hold up the first frame
+	fallbackShader.addStage(GL_VERTEX_SHADER, "shaders/v_fallback.glsl");
+	fallbackShader.addStage(GL_FRAGMENT_SHADER, "shaders/f_fallback.glsl");
+	fallbackShader.setOnLink(bindBlocks);
+	fallbackShader.setCacheDir(cacheDir);
+	fallbackShader.build();
+
+	// Variants are compiled as meshes need them (see ShaderPermutations)
+	shaders.addStage(GL_VERTEX_SHADER, "shaders/v.glsl");
+	shaders.addStage(GL_FRAGMENT_SHADER, "shaders/f.glsl");
+	shaders.setOnLink(bindBlocks);
+	shaders.setCacheDir(cacheDir);
+
+	// Instanced variants of the vertex shader
+	instShaders.addStage(GL_VERTEX_SHADER, "shaders/v_instanced.glsl");
+	instShaders.addStage(GL_FRAGMENT_SHADER, "shaders/f.glsl");
+	instShaders.setOnLink([](GLuint program) {
+		glUniformBlockBinding(program, glGetUniformBlockIndex(program, "FrameConstants"), frameBinding);
+		glUseProgram(program);
+		glUniform1i(glGetUniformLocation(program, "instances"), 0);  // texture unit 0
+		glUseProgram(0);
+	});
+	instShaders.setUniforms({ "instanceBase", "octScale" });  // instanceBaseUniform, octScaleUniform
+	instShaders.setCacheDir(cacheDir);
+
+	// Submit the variants the default vertex format needs right away
+	uint32_t features = ShaderPermutations::featuresFor(vertexFormat, showNormals);
+	ShaderProgram* programs[] = { &shaders.get(features), &instShaders.get(features) };
+	std::cout << "Fallback program: " << fallbackShader.getBuildMs() << " ms" << std::endl;
+	for (int i = 0; i < 2; i++) {
+		if (programs[i]->isReady())
+			reportShader(*programs[i], i == 1, features);
+	}
+	if (shadersPending()) {
+		std::cout << "Compiling shaders while drawing with the fallback program ("
+			<< (ShaderProgram::parallelCompileSupported() ? "driver compiler threads" : "no parallel compile extension") << ")" << std::endl;
+	}
+	if (shaderCache && !programBinarySupported())
+		std::cout << "Program binaries are not supported by the driver; shaders are compiled every time" << std::endl;
+
+	shaderWatcher = std::unique_ptr<FileWatcher>(new FileWatcher("shaders"));
+	if (shaderWatcher->isWatching())
+		std::cout << "Watching shaders/ for changes" << std::endl;
+
+	// Instance transforms are read as four RGBA32F texels each, from a ring of streamFrames
+	// frames' worth that the texture buffer covers entirely
+	GLint maxTexels;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+	size_t streamBytes = std::min((size_t)maxTexels * 4 * sizeof(GLfloat), maxStreamBytes);
+	maxInstances = streamBytes / sizeof(glm::mat4) / streamFrames;
+	instStream = std::unique_ptr<StreamBuffer>(new StreamBuffer(maxInstances * streamFrames * sizeof(glm::mat4), streamFrames));
+	glGenTextures(1, &instTex);
+	glBindTexture(GL_TEXTURE_BUFFER, instTex);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, instStream->buffer());
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	std::cout << "Streaming instance transforms through a " << (instStream->size() >> 10) << " KiB ring ("
+		<< (instStream->isPersistent() ? "persistently mapped" : "unsynchronized maps") << ")" << std::endl;
+
+	// Uniform buffers. Object constants are bound per draw at offsets that are multiples of
+	// the required alignment.
+	GLint alignment;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	alignment = std::max(alignment, 1);
+	objectStride = (sizeof(ObjectConstants) + alignment - 1) / alignment * alignment;
+	glGenBuffers(1, &frameUbo);
+	glBindBuffer(GL_UNIFORM_BUFFER, frameUbo);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameConstants), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, frameBinding, frameUbo);
+	glGenBuffers(1, &objectUbo);
+}
+
+bool GLState::shadersPending() const {
+	return shaders.isPending() || instShaders.isPending();
+}
+
+void GLState::pollShaders() {
+	for (uint32_t features : shaders.poll())
+		reportShader(shaders.get(features), false, features);
+	for (uint32_t features : instShaders.poll())
+		reportShader(instShaders.get(features), true, features);
+}
+
+void GLState::reportShader(const ShaderProgram& program, bool instanced, uint32_t features) {
+	std::cout << "Shader program " << program.id() << " (" << (instanced ? "instanced, " : "")
+		<< ShaderPermutations::describe(features) << "): " << program.getBuildMs() << " ms "
+		<< (program.isFromCache() ? "from the binary cache" : "compiled from source") << std::endl;
+}
+
+bool GLState::reloadShaders() {
+	std::vector<std::string> changed = shaderWatcher ? shaderWatcher->poll() : std::vector<std::string>();
+	if (changed.empty())
+		return false;
+	bool replaced = shaders.reload(changed);
+	replaced = instShaders.reload(changed) || replaced;
+	if (replaced) {
+		std::cout << "Reloaded shaders after changes to";
+		for (const std::string& f : changed)
+			std::cout << " " << f;
+		std::cout << std::endl;
+	}
+	return replaced;
 }
 
 // Start rotating the camera (click + drag)
@@ -4,11 +4,19 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <chrono>
 #include <glm/glm.hpp>
 #include "gl_core_3_3.h"
 #include "mesh.hpp"
 #include "camera.hpp"
 #include "scene.hpp"
+#include "renderqueue.hpp"
+#include "arena.hpp"
+#include "streambuffer.hpp"
+#include "loader.hpp"
+#include "shader.hpp"
+#include "permutations.hpp"
+#include "watcher.hpp"
 
 // Manages OpenGL state, e.g. camera transform, objects, shaders
 class GLState {
@@ -28,6 +36,38 @@ public:
 
 	// Set object to display
 	void showScene();
+	// Rebuild the programs whose shader files changed since the last call (on the GL thread,
+	// between frames). Returns whether any program was replaced.
+	bool reloadShaders();
+	// Vertex format of the scene meshes; takes effect on the next showScene()
+	inline void setVertexFormat(Mesh::VertexFormat format) { vertexFormat = format; }
+	// Draw all visible copies of a model at the same level of detail with one instanced call
+	inline bool isInstancing() const { return instancing; }
+	inline void setInstancing(bool enable) { instancing = enable; }
+	// Merge objects marked static in the scene file into pre-transformed batches; takes effect on the next showScene()
+	inline void setStaticBatching(bool enable) { staticBatching = enable; }
+	// Load scenes on a background thread, drawing what has arrived meanwhile; set before initializeGL()
+	inline void setAsyncLoading(bool enable) { asyncLoading = enable; }
+	// Load linked shader programs from the binary cache in shaders/.programcache; set before initializeGL()
+	inline void setShaderCache(bool enable) { shaderCache = enable; }
+	// Shade objects by their normals instead of their vertex colors; takes effect on the next showScene()
+	inline void setShowNormals(bool enable) { showNormals = enable; }
+	// Whether the models of the scene are still arriving (keep redrawing meanwhile)
+	inline bool isLoading() const { return scene && scene->isLoading(); }
+	// Whether shader programs are still compiling (keep redrawing meanwhile)
+	bool shadersPending() const;
+
+	// Layouts of the uniform blocks declared in the vertex shaders (std140)
+	struct FrameConstants {
+		glm::mat4 view;			// World-to-eye space
+		glm::mat4 proj;			// Eye-to-clip space
+		glm::mat4 viewProj;		// World-to-clip space
+		glm::vec4 cameraPos;	// World-space eye position (w unused)
+	};
+	struct ObjectConstants {
+		glm::mat4 model;		// Stored vertex positions to world space
+		glm::vec4 params;		// x: octahedral normal scale (see Mesh::octNormalScale)
+	};
 
 	// Per-vertex attributes
 	struct Vertex {
@@ -53,21 +93,86 @@ public:
 	void offsetCamera(float offset);  // use the scroll wheel to move closer / farther
 	inline float getMoveStep() { return moveStep; }
 
+	// Objects drawn and skipped by frustum culling in the last frame
+	inline size_t getVisibleCount() const { return visibleCount; }
+	inline size_t getCulledCount() const { return culledCount; }
+	// Draw calls issued in the last frame, and how many fewer that is than one per visible object
+	inline size_t getDrawCalls() const { return drawCalls; }
+	inline size_t getDrawCallsSaved() const { return visibleCount - drawCalls; }
+	// Uploads of per-frame data that had to wait for the GPU, and the time they waited
+	inline size_t getStreamStalls() const { return instStream ? instStream->getStalls() : 0; }
+	inline double getStreamStallMs() const { return instStream ? instStream->getStallMs() : 0.0; }
+
 protected:
 	// Initialization
 	void initShaders();
+	// Collect the programs the driver finished compiling, once per frame
+	void pollShaders();
+	void reportShader(const ShaderProgram& program, bool instanced, uint32_t features);
+	// Level of detail to draw an object at, seen with the given vertical field of view in a
+	// viewport of the given height in pixels
+	size_t selectLod(const Mesh& mesh, const glm::mat4& modelMat, const glm::mat4& view, float fovy, float height);
+	// Upload the camera block if the active camera changed since the last frame
+	void updateFrameConstants(Camera& cam);
+	// Upload the constants of every scene object, once per scene
+	void uploadObjectConstants();
+	// Refresh the object constants and per-frame storage after objects were added
+	void prepareScene();
+	// Take in the meshes the loader has finished, timing the frames while the scene loads
+	void updateLoading();
+	// Draw the visible objects one at a time, or grouped into instanced draws
+	void drawObjects(const std::vector<SceneObject>& objects);
+	void drawInstances(const std::vector<SceneObject>& objects);
+	// Program to draw objects of a shader variant with one at a time
+	GLuint objectProgram(uint32_t features);
 
-	std::string meshFilename;		// Name of the obj file being shown
-	std::unique_ptr<Mesh> mesh;		// Pointer to mesh object
+	std::unique_ptr<GeometryArena> arena;	// Buffers of the scene meshes (outlives the scene)
 	std::unique_ptr<Scene> scene;   // Pointer to the scene object
+	Mesh::VertexFormat vertexFormat;  // GPU vertex layout of the scene meshes
+	bool instancing;		// Whether repeated models are drawn with instanced calls
+	bool staticBatching;	// Whether static objects are merged into batches
+	bool asyncLoading;		// Whether scenes load on the loader thread
+	bool shaderCache;		// Whether program binaries are cached
+	int viewportHeight;		// Window height in pixels, for the screen size of objects
+	bool showNormals;		// Whether the shader variants with normals are used
+	std::unique_ptr<AssetLoader> loader;	// Background loader, if asyncLoading
+
+	// Hitches while a scene loads in the background
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point loadStart;	// When the scene started loading
+	Clock::time_point frameStart;	// When the previous frame started
+	size_t loadFrames;				// Frames drawn while loading
+	double longestFrameMs;			// Longest time between two of those frames
+	double longestIntegrateMs;		// Longest time a frame spent taking in finished meshes
+	double integrateMs;				// Total time spent taking them in
 
 	// OpenGL state
-	GLuint shader;		// GPU shader program
-	GLuint xformLoc;	// Transformation matrix location
-	GLuint vao;			// Vertex array object
-	GLuint vbuf;		// Vertex buffer
-	GLuint ibuf;		// Index buffer
-	GLsizei vcount;		// Number of indices to draw
+	ShaderPermutations shaders;		// Variants of the GPU shader program
+	ShaderProgram fallbackShader;	// Flat-colored stand-in drawn with until a variant is ready
+	std::unique_ptr<FileWatcher> shaderWatcher;	// Changes to the files in shaders/
+
+	// Instanced drawing state
+	ShaderPermutations instShaders;	// Variants that read each instance's transform from instTex
+	std::unique_ptr<StreamBuffer> instStream;	// Instance transforms, rewritten every frame
+	GLuint instTex;			// Texture buffer view of instStream
+	size_t maxInstances;	// Transforms uploaded at once (a third of the ring)
+	std::vector<glm::mat4> instanceMats;	// Transforms staged for instStream
+
+	// Uniform buffers
+	GLuint frameUbo;		// FrameConstants of the active camera
+	GLuint objectUbo;		// ObjectConstants of every scene object, objectStride bytes apart
+	GLsizeiptr objectStride;	// sizeof(ObjectConstants) rounded up to the offset alignment
+	const Camera* frameCamera;	// Camera whose matrices frameUbo holds
+	unsigned frameRevision;		// Its revision at the time
+
+	std::vector<uint32_t> visibleObjects;	// Indices of the objects drawn this frame
+	std::vector<glm::mat4> objectMats;		// Stored positions to world transform of each object
+	RenderQueue queue;						// Draw order of the visible objects
+
+	// Frame statistics
+	size_t visibleCount;	// Objects that passed frustum culling
+	size_t culledCount;		// Objects outside the view frustum
+	size_t drawCalls;		// Draw calls issued
 
 	// cameras:
 	Camera cam_ground, cam_overhead;
@@ -0,0 +1,336 @@
+#define NOMINMAX
+#include "loader.hpp"
+#include <iostream>
+#include <algorithm>
+#include <future>
+#include <chrono>
+#include "threadpool.hpp"
+#include "batch.hpp"
+#include "mapfile.hpp"
+#include "meshcache.hpp"
+// After the GL loader header, so the system gl.h it pulls in is skipped
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <GL/glx.h>
+#endif
+
+// Requests and results in flight at once; more requests wait on the render thread
+static const size_t queueCapacity = 64;
+
+#ifdef _WIN32
+// WGL_ARB_create_context
+typedef HGLRC (WINAPI *PFN_wglCreateContextAttribsARB)(HDC dc, HGLRC share, const int* attribs);
+static const int WGL_CONTEXT_MAJOR_VERSION = 0x2091;
+static const int WGL_CONTEXT_MINOR_VERSION = 0x2092;
+static const int WGL_CONTEXT_PROFILE_MASK = 0x9126;
+static const int WGL_CONTEXT_CORE_PROFILE_BIT = 0x0001;
+
+// A context sharing objects with the window's, current on the window's device context
+struct AssetLoader::Context {
+	HDC dc = NULL;
+	HGLRC context = NULL;
+
+	static std::unique_ptr<Context> create() {
+		HDC dc = wglGetCurrentDC();
+		HGLRC share = wglGetCurrentContext();
+		PFN_wglCreateContextAttribsARB createContext =
+			(PFN_wglCreateContextAttribsARB)wglGetProcAddress("wglCreateContextAttribsARB");
+		if (!dc || !share || !createContext)
+			return nullptr;
+		const int attribs[] = { WGL_CONTEXT_MAJOR_VERSION, 3, WGL_CONTEXT_MINOR_VERSION, 3,
+			WGL_CONTEXT_PROFILE_MASK, WGL_CONTEXT_CORE_PROFILE_BIT, 0 };
+		HGLRC context = createContext(dc, share, attribs);
+		if (!context)
+			return nullptr;
+		std::unique_ptr<Context> c(new Context());
+		c->dc = dc;
+		c->context = context;
+		return c;
+	}
+	~Context() { if (context) wglDeleteContext(context); }
+	bool makeCurrent() { return wglMakeCurrent(dc, context) == TRUE; }
+	void doneCurrent() { wglMakeCurrent(NULL, NULL); }
+};
+
+void AssetLoader::initThreads() {}
+
+#else
+// GLX_ARB_create_context
+typedef GLXContext (*PFN_glXCreateContextAttribsARB)(Display* display, GLXFBConfig config,
+	GLXContext share, Bool direct, const int* attribs);
+static const int GLX_CONTEXT_MAJOR_VERSION = 0x2091;
+static const int GLX_CONTEXT_MINOR_VERSION = 0x2092;
+static const int GLX_CONTEXT_PROFILE_MASK = 0x9126;
+static const int GLX_CONTEXT_CORE_PROFILE_BIT = 0x0001;
+
+// Failed GLX requests are reported as X errors, which end the program by default
+static bool xErrorRaised = false;
+static int ignoreXError(Display*, XErrorEvent*) {
+	xErrorRaised = true;
+	return 0;
+}
+
+// A context sharing objects with the window's, current on a 1x1 pbuffer it never draws to
+struct AssetLoader::Context {
+	Display* display = nullptr;
+	GLXContext context = nullptr;
+	GLXPbuffer pbuffer = 0;
+
+	static std::unique_ptr<Context> create() {
+		Display* display = glXGetCurrentDisplay();
+		GLXContext share = glXGetCurrentContext();
+		PFN_glXCreateContextAttribsARB createContext = (PFN_glXCreateContextAttribsARB)
+			glXGetProcAddressARB((const GLubyte*)"glXCreateContextAttribsARB");
+		if (!display || !share || !createContext)
+			return nullptr;
+
+		// A configuration of the window's screen that supports pbuffers, the window's own if it does
+		int screen = 0, configId = 0;
+		glXQueryContext(display, share, GLX_SCREEN, &screen);
+		glXQueryContext(display, share, GLX_FBCONFIG_ID, &configId);
+		const int byId[] = { GLX_FBCONFIG_ID, configId, None };
+		const int byType[] = { GLX_DRAWABLE_TYPE, GLX_PBUFFER_BIT, GLX_RENDER_TYPE, GLX_RGBA_BIT, None };
+		GLXFBConfig config = 0;
+		for (const int* attribs : { byId, byType }) {
+			int n = 0;
+			GLXFBConfig* configs = glXChooseFBConfig(display, screen, attribs, &n);
+			for (int i = 0; i < n && !config; i++) {
+				int types = 0;
+				glXGetFBConfigAttrib(display, configs[i], GLX_DRAWABLE_TYPE, &types);
+				if (types & GLX_PBUFFER_BIT)
+					config = configs[i];
+			}
+			if (configs)
+				XFree(configs);
+			if (config)
+				break;
+		}
+		if (!config)
+			return nullptr;
+
+		const int contextAttribs[] = { GLX_CONTEXT_MAJOR_VERSION, 3, GLX_CONTEXT_MINOR_VERSION, 3,
+			GLX_CONTEXT_PROFILE_MASK, GLX_CONTEXT_CORE_PROFILE_BIT, None };
+		const int pbufferAttribs[] = { GLX_PBUFFER_WIDTH, 1, GLX_PBUFFER_HEIGHT, 1, None };
+		std::unique_ptr<Context> c(new Context());
+		c->display = display;
+		XSync(display, False);
+		xErrorRaised = false;
+		int (*oldHandler)(Display*, XErrorEvent*) = XSetErrorHandler(ignoreXError);
+		c->context = createContext(display, config, share, glXIsDirect(display, share), contextAttribs);
+		if (c->context)
+			c->pbuffer = glXCreatePbuffer(display, config, pbufferAttribs);
+		XSync(display, False);
+		XSetErrorHandler(oldHandler);
+		if (xErrorRaised || !c->context || !c->pbuffer)
+			return nullptr;
+		return c;
+	}
+	~Context() {
+		if (context) glXDestroyContext(display, context);
+		if (pbuffer) glXDestroyPbuffer(display, pbuffer);
+	}
+	bool makeCurrent() { return glXMakeContextCurrent(display, pbuffer, pbuffer, context) == True; }
+	void doneCurrent() { glXMakeContextCurrent(display, None, None, NULL); }
+};
+
+// freeglut's display connection is used from the loader thread too
+void AssetLoader::initThreads() {
+	XInitThreads();
+}
+#endif
+
+AssetLoader::AssetLoader() :
+	shared(false),
+	requests(queueCapacity),
+	results(queueCapacity),
+	requested(0),
+	completed(0),
+	stopping(false) {
+	context = Context::create();
+	// The thread reports whether it could make the context current before taking requests
+	std::promise<bool> started;
+	std::future<bool> current = started.get_future();
+	thread = std::thread([this](std::promise<bool> started) {
+		bool ok = context && context->makeCurrent();
+		started.set_value(ok);
+		threadLoop();
+		if (ok)
+			context->doneCurrent();
+	}, std::move(started));
+	shared = current.get();
+	if (!shared)
+		std::cerr << "No GL context shared with the loader thread; models are uploaded on the render thread" << std::endl;
+}
+
+AssetLoader::~AssetLoader() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_one();
+	if (thread.joinable())
+		thread.join();
+
+	// Buffers and fences are shared, so whatever was not taken can be freed from here
+	while (Result* r = results.front()) {
+		if (r->fence)
+			glDeleteSync(r->fence);
+		r->staged.release();
+		results.pop();
+	}
+}
+
+void AssetLoader::request(Request&& r) {
+	requested++;
+	if (!overflow.empty() || !requests.push(std::move(r))) {
+		overflow.push_back(std::move(r));
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	wake.notify_one();
+}
+
+bool AssetLoader::poll(Result& out) {
+	// Hand over waiting requests as the loader makes room
+	if (!overflow.empty()) {
+		size_t moved = 0;
+		while (!overflow.empty() && requests.push(std::move(overflow.front()))) {
+			overflow.pop_front();
+			moved++;
+		}
+		if (moved) {
+			std::lock_guard<std::mutex> lock(mutex);
+			wake.notify_one();
+		}
+	}
+
+	Result* r = results.front();
+	if (!r)
+		return false;
+	if (r->fence) {
+		GLenum status = glClientWaitSync(r->fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			return false;  // still uploading; results stay in order
+		glDeleteSync(r->fence);
+		r->fence = 0;
+	}
+	out = std::move(*r);
+	results.pop();
+	if (!out.empty && !out.staged.vbuf)
+		out.staged = Mesh::stage(out.geom, out.format);  // no shared context: upload here
+	if (out.last)
+		completed++;
+	return true;
+}
+
+void AssetLoader::threadLoop() {
+	while (true) {
+		Request* r = requests.front();
+		if (!r) {
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return stopping || !requests.empty(); });
+			if (stopping)
+				return;
+			continue;
+		}
+		Request req = std::move(*r);
+		requests.pop();
+		handle(req);
+		if (stopping)
+			return;
+	}
+}
+
+void AssetLoader::handle(Request& r) {
+	// A mesh for the request: staged here with a shared context, else left for poll()
+	auto make = [&](Mesh::Geometry& geom, bool last, uint64_t contentHash) {
+		Result res;
+		res.owner = r.owner;
+		res.id = r.id;
+		res.last = last;
+		res.empty = false;
+		res.format = r.format;
+		res.contentHash = contentHash;
+		if (shared)
+			res.staged = Mesh::stage(geom, r.format);
+		else
+			res.geom = std::move(geom);
+		publish(std::move(res));
+	};
+	auto fail = [&](const std::string& error, bool last) {
+		Result res;
+		res.owner = r.owner;
+		res.id = r.id;
+		res.last = last;
+		res.error = error;
+		publish(std::move(res));
+	};
+
+	try {
+		if (r.modelMats.empty()) {
+			// The hash lets the requester share the mesh with a copy under another name
+			uint64_t contentHash;
+			{
+				MappedFile file(r.filenames.at(0));
+				contentHash = hashBytes(file.data(), file.size());
+			}
+			Mesh::Geometry geom = Mesh::readFile(r.filenames[0]);
+			make(geom, true, contentHash);
+			return;
+		}
+
+		// Read each distinct model of the placements once, on the worker pool
+		std::vector<std::string> names(r.filenames);
+		std::sort(names.begin(), names.end());
+		names.erase(std::unique(names.begin(), names.end()), names.end());
+		std::vector<Mesh::Geometry> geoms(names.size());
+		std::vector<std::string> errors(names.size());
+		ThreadPool::instance().parallelFor(names.size(), [&](size_t k) {
+			try {
+				geoms[k] = Mesh::readFile(names[k]);
+			} catch (const std::exception& e) {
+				errors[k] = e.what();
+			}
+		});
+		std::vector<StaticInstance> instances;
+		for (size_t i = 0; i < r.filenames.size(); i++) {
+			size_t k = std::lower_bound(names.begin(), names.end(), r.filenames[i]) - names.begin();
+			if (errors[k].empty())
+				instances.push_back(StaticInstance{ &geoms[k], r.modelMats[i] });
+		}
+		for (const std::string& e : errors) {
+			if (!e.empty())
+				fail(e, false);  // skip models that failed to load
+		}
+
+		// Each batch is passed on as soon as it is uploaded
+		std::vector<Mesh::Geometry> batches = buildStaticBatches(instances);
+		geoms.clear();
+		for (size_t b = 0; b < batches.size(); b++) {
+			make(batches[b], b + 1 == batches.size(), 0);
+			batches[b] = Mesh::Geometry();
+		}
+		if (batches.empty())
+			fail(std::string(), true);
+	} catch (const std::exception& e) {
+		fail(e.what(), true);
+	}
+}
+
+void AssetLoader::publish(Result&& r) {
+	if (!r.empty && shared) {
+		// The render thread waits on the fence, so it must reach the GPU
+		r.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glFlush();
+	}
+	while (!results.push(std::move(r))) {
+		if (stopping) {
+			if (r.fence)
+				glDeleteSync(r.fence);
+			r.staged.release();
+			return;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
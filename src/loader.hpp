@@ -0,0 +1,95 @@
+#ifndef LOADER_HPP
+#define LOADER_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "gl_core_3_3.h"
+#include "mesh.hpp"
+#include "spscqueue.hpp"
+
+// Loads models on a thread of its own so the render thread never waits for parsing or
+// uploads. The thread has a GL context shared with the window's: it reads each model, packs
+// and uploads it into staging buffers (see Mesh::stage), fences the uploads, and hands the
+// result to the render thread through a lock-free queue. The render thread takes results
+// whose fence has signaled and adopts their buffers (e.g. with a GPU copy into an arena).
+// Without a shared context, the thread only parses, and poll() uploads on the render thread.
+class AssetLoader {
+public:
+	// A model to load, or static placements of models to merge into batches (see batch.hpp)
+	struct Request {
+		uint32_t owner;		// Tag of the requester, returned with the results
+		uint32_t id;		// Requester's number for this request
+		std::vector<std::string> filenames;	// The model, or the model of each placement
+		std::vector<glm::mat4> modelMats;	// Placements to batch; empty to load filenames[0] as is
+		Mesh::VertexFormat format;
+	};
+	// One mesh made for a request. Batch requests make several; every request ends with a
+	// result that has last set.
+	struct Result {
+		uint32_t owner = 0;
+		uint32_t id = 0;
+		bool last = true;
+		bool empty = true;		// No mesh (the request failed or made nothing)
+		std::string error;		// Why the request failed
+		Mesh::VertexFormat format = Mesh::VERTEX_FLOAT;
+		uint64_t contentHash = 0;	// hashBytes() of the model file; 0 for batches
+		Mesh::Staged staged;	// Buffers ready to be taken over
+		Mesh::Geometry geom;	// CPU geometry, uploaded by poll() without a shared context
+		GLsync fence = 0;		// Signaled when the staged uploads are complete
+	};
+
+	// Call on the render thread with the window's context current
+	AssetLoader();
+	~AssetLoader();
+	// Disallow copy, move, & assignment
+	AssetLoader(const AssetLoader& other) = delete;
+	AssetLoader& operator=(const AssetLoader& other) = delete;
+	AssetLoader(AssetLoader&& other) = delete;
+	AssetLoader& operator=(AssetLoader&& other) = delete;
+
+	// Make the window system connection safe for a second GL thread. Call before anything else
+	// opens it (i.e. before glutInit).
+	static void initThreads();
+
+	// render thread: queue a request (never blocks)
+	void request(Request&& r);
+	// render thread: take the next result whose uploads are complete; false if there is none yet.
+	// The result's staged buffers belong to the caller (see Mesh::Mesh(Staged&) and Staged::release).
+	bool poll(Result& out);
+
+	// access:
+	inline bool hasSharedContext() const { return shared; }
+	inline size_t getRequested() const { return requested; }
+	inline size_t getCompleted() const { return completed; }
+	inline bool isIdle() const { return completed == requested; }
+
+protected:
+	void threadLoop();
+	void handle(Request& r);
+	void publish(Result&& r);  // Fence the uploads and pass the result on
+
+	struct Context;						// Platform GL context of the loader thread
+	std::unique_ptr<Context> context;	// Null if a shared context could not be made
+	bool shared;						// Whether the loader thread uploads
+
+	SpscQueue<Request> requests;		// Render thread -> loader thread
+	SpscQueue<Result> results;			// Loader thread -> render thread
+	std::deque<Request> overflow;		// Requests waiting for room in the queue (render thread)
+	size_t requested;					// Requests made (render thread)
+	size_t completed;					// Requests whose last result was taken (render thread)
+
+	std::thread thread;
+	std::mutex mutex;					// Only for sleeping; the queues need no lock
+	std::condition_variable wake;		// Signaled when requests arrive or the loader stops
+	std::atomic<bool> stopping;
+};
+
+#endif
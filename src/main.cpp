@@ -2,7 +2,11 @@
 #include <memory>
 #include <filesystem>
 #include <algorithm>
+#include <cstring>
+#include <sstream>
 #include "glstate.hpp"
+#include "loader.hpp"
+#include "bench.hpp"
 #include <GL/freeglut.h>
 namespace fs = std::filesystem;
 
@@ -31,12 +35,49 @@ void cleanup();
 
 // Program entry point
 int main(int argc, char** argv) {
+	// Command-line tools that do not need a window
+	int exitCode;
+	if (runReport(argc, argv, exitCode))
+		return exitCode;
+
+	// Viewer options
+	Mesh::VertexFormat vertexFormat = Mesh::VERTEX_FLOAT;
+	bool staticBatching = true;
+	bool asyncLoading = true;
+	bool shaderCache = true;
+	bool showNormals = false;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--no-static-batching") == 0)
+			staticBatching = false;
+		if (strcmp(argv[i], "--sync-loading") == 0)
+			asyncLoading = false;
+		if (strcmp(argv[i], "--no-shader-cache") == 0)
+			shaderCache = false;
+		if (strcmp(argv[i], "--show-normals") == 0)
+			showNormals = true;
+		if (strcmp(argv[i], "--vertex-format") == 0 && i + 1 < argc) {
+			std::string name = argv[++i];
+			if (name == "float") vertexFormat = Mesh::VERTEX_FLOAT;
+			else if (name == "compact") vertexFormat = Mesh::VERTEX_COMPACT;
+			else if (name == "small") vertexFormat = Mesh::VERTEX_SMALL;
+			else {
+				std::cerr << "Unknown vertex format " << name << " (use float, compact, or small)" << std::endl;
+				return -1;
+			}
+		}
+	}
+
 	try {
 		// Create the window and menu
 		initGLUT(&argc, argv);
 		initMenu();
 		// Initialize OpenGL (buffers, shaders, etc.)
 		glState = std::unique_ptr<GLState>(new GLState());
+		glState->setVertexFormat(vertexFormat);
+		glState->setStaticBatching(staticBatching);
+		glState->setAsyncLoading(asyncLoading);
+		glState->setShaderCache(shaderCache);
+		glState->setShowNormals(showNormals);
 		glState->initializeGL();
 
 	} catch (const std::exception& e) {
@@ -57,6 +98,7 @@ int main(int argc, char** argv) {
 	std::cout << "  Z:  Move down" << std::endl;
 	std::cout << "  C:  Move up" << std::endl;
 	std::cout << "  S:  Switch between the two cameras (a ground camera and an overhead camera)" << std::endl;
+	std::cout << "  I:  Toggle instanced drawing of repeated models" << std::endl;
 	std::cout << std::endl;
 
 	// Execute main loop
@@ -69,6 +111,7 @@ int main(int argc, char** argv) {
 void initGLUT(int* argc, char** argv) {
 	// Set window and context settings
 	int width = 800; int height = 800;
+	AssetLoader::initThreads();  // the loader thread shares the window system connection
 	glutInit(argc, argv);
 	glutInitWindowSize(width, height);
 	glutInitContextVersion(3, 3);
@@ -117,6 +160,23 @@ void display() {
 	// Tell the GLState to render the scene
 	glState->paintGL();
 
+	// Show the culling results, and any instance uploads that had to wait for the GPU, in the
+	// title bar when they change
+	static size_t shownVisible = ~size_t(0), shownCulled = ~size_t(0), shownDraws = ~size_t(0), shownStalls = 0;
+	if (glState->getVisibleCount() != shownVisible || glState->getCulledCount() != shownCulled ||
+		glState->getDrawCalls() != shownDraws || glState->getStreamStalls() != shownStalls) {
+		shownVisible = glState->getVisibleCount();
+		shownCulled = glState->getCulledCount();
+		shownDraws = glState->getDrawCalls();
+		shownStalls = glState->getStreamStalls();
+		std::stringstream title;
+		title << "FreeGLUT Window - " << shownVisible << " visible, " << shownCulled << " culled, "
+			<< shownDraws << " draws (" << glState->getDrawCallsSaved() << " saved by instancing)";
+		if (shownStalls)
+			title << ", " << shownStalls << " stream stalls (" << (int)glState->getStreamStallMs() << " ms)";
+		glutSetWindowTitle(title.str().c_str());
+	}
+
 	// Scene is rendered to the back buffer, so swap the buffers to display it
 	glutSwapBuffers();
 }
@@ -166,6 +226,10 @@ void keyPress(unsigned char key, int x, int y) {
 		glState->getCamera(glState->getCamType()).moveDown();
 		glutPostRedisplay();
 		break;
+	case 'i':  // toggle instancing
+		glState->setInstancing(!glState->isInstancing());
+		glutPostRedisplay();
+		break;
 	}
 }
 
@@ -207,6 +271,15 @@ void mouseMove(int x, int y) {
 void idle() {
 	// TODO: anything that happens every frame (e.g. movement) should be done here
 	// Be sure to call glutPostRedisplay() if the screen needs to update as well
+
+	// Pick up edited shaders between frames
+	if (glState && glState->reloadShaders())
+		glutPostRedisplay();
+
+	// Keep drawing while the scene loads, so its objects show up as they arrive, and while
+	// shaders compile, so the finished programs replace the fallback
+	if (glState && (glState->isLoading() || glState->shadersPending()))
+		glutPostRedisplay();
 }
 
 // Called when a menu button is pressed
@@ -0,0 +1,83 @@
+#define NOMINMAX
+#include "mapfile.hpp"
+#include <sstream>
+#include <stdexcept>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Map the whole file into memory (read-only)
+MappedFile::MappedFile(const std::string& filename) :
+	ptr(nullptr),
+	length(0),
+#if defined(_WIN32)
+	file(INVALID_HANDLE_VALUE),
+	mapping(NULL)
+#else
+	fd(-1)
+#endif
+{
+	auto fail = [&](const char* what) {
+		release();
+		std::stringstream ss;
+		ss << "Error reading " << filename << ": " << what;
+		throw std::runtime_error(ss.str());
+	};
+
+#if defined(_WIN32)
+	file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		fail("failed to open file");
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize))
+		fail("failed to query file size");
+	length = (size_t)fileSize.QuadPart;
+	if (length == 0)
+		return;  // empty files cannot be mapped
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL)
+		fail("failed to map file");
+	ptr = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (ptr == nullptr)
+		fail("failed to map file");
+#else
+	fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		fail("failed to open file");
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+		fail("failed to query file size");
+	length = (size_t)st.st_size;
+	if (length == 0)
+		return;  // empty files cannot be mapped
+	void* addr = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (addr == MAP_FAILED)
+		fail("failed to map file");
+	ptr = (const char*)addr;
+	madvise(addr, length, MADV_SEQUENTIAL);  // we only ever stream through the file once
+#endif
+}
+
+// Unmap the file and close the handles
+void MappedFile::release() {
+#if defined(_WIN32)
+	if (ptr) UnmapViewOfFile(ptr);
+	if (mapping) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+	mapping = NULL;
+	file = INVALID_HANDLE_VALUE;
+#else
+	if (ptr) munmap((void*)ptr, length);
+	if (fd >= 0) close(fd);
+	fd = -1;
+#endif
+	ptr = nullptr;
+	length = 0;
+}
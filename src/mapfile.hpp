@@ -0,0 +1,36 @@
+#ifndef MAPFILE_HPP
+#define MAPFILE_HPP
+
+#include <string>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+	MappedFile(const std::string& filename);
+	~MappedFile() { release(); }
+	// Disallow copy, move, & assignment
+	MappedFile(const MappedFile& other) = delete;
+	MappedFile& operator=(const MappedFile& other) = delete;
+	MappedFile(MappedFile&& other) = delete;
+	MappedFile& operator=(MappedFile&& other) = delete;
+
+	// access:
+	inline const char* data() const { return ptr; }
+	inline const char* end() const { return ptr + length; }
+	inline size_t size() const { return length; }
+
+protected:
+	void release();		// Unmap the file
+
+	const char* ptr;	// Start of the mapped bytes (nullptr for an empty file)
+	size_t length;		// Size of the file in bytes
+#if defined(_WIN32)
+	void* file;			// File handle
+	void* mapping;		// File mapping handle
+#else
+	int fd;				// File descriptor
+#endif
+};
+
+#endif
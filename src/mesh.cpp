@@ -2,152 +2,266 @@
 #include "mesh.hpp"
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-#include <fstream>
 #include <iostream>
 #include <sstream>
-
-// Helper functions
-int indexOfNumberLetter(std::string& str, int offset);
-int lastIndexOfNumberLetter(std::string& str);
-std::vector<std::string> split(const std::string &s, char delim);
+#include <filesystem>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include "mapfile.hpp"
+#include "objparser.hpp"
+#include "plyparser.hpp"
+#include "threadpool.hpp"
+#include "meshcache.hpp"
+#include "meshopt.hpp"
+#include "simplify.hpp"
+#include "arena.hpp"
+
+// Number of triangle corners each task expands when building vertex arrays
+static const size_t cornerBlock = 3 * (1 << 14);
 
 // Constructor - load mesh from file
-Mesh::Mesh(std::string filename, bool keepLocalGeometry) {
+Mesh::Mesh(std::string filename, bool keepLocalGeometry, VertexFormat format) : format(format) {
 	minBB = glm::vec3(std::numeric_limits<float>::max());
 	maxBB = glm::vec3(std::numeric_limits<float>::lowest());
 
-	modelMat = glm::mat4(1.0f);  // initialize with an identity matrix
+	quantError = QuantizationError{ 0.0f, 0.0f, 0.0f };
+	arena = nullptr;
+	arenaHandle = GeometryArena::invalidHandle;
+	vao = 0;
+	vbuf = 0;
+	ibuf = 0;
+	vcount = 0;
+	icount = 0;
+	itype = GL_NONE;
+	Geometry geom = readFile(filename);
+	upload(geom, keepLocalGeometry);
+}
 
+// Constructor - upload geometry that was already read, e.g. on a worker thread
+Mesh::Mesh(Geometry& geom, bool keepLocalGeometry, VertexFormat format, GeometryArena* arena) : format(format), arena(arena) {
+	quantError = QuantizationError{ 0.0f, 0.0f, 0.0f };
+	arenaHandle = GeometryArena::invalidHandle;
+	if (arena && arena->vertexFormat() != format)
+		throw std::runtime_error("Mesh vertex format differs from its geometry arena's");
 	vao = 0;
 	vbuf = 0;
+	ibuf = 0;
 	vcount = 0;
-	//loadOBJ(filename, keepLocalGeometry);
-	loadPLY(filename, keepLocalGeometry);
+	icount = 0;
+	itype = GL_NONE;
+	upload(geom, keepLocalGeometry);
+}
+
+// Constructor - adopt buffers staged by Mesh::stage(), e.g. on a loader thread. With an arena,
+// the data is copied into it on the GPU and the staging buffers are deleted.
+Mesh::Mesh(Staged& staged, GeometryArena* arena) : format(staged.format), arena(arena) {
+	if (arena && arena->vertexFormat() != format)
+		throw std::runtime_error("Mesh vertex format differs from its geometry arena's");
+	minBB = staged.minBB;
+	maxBB = staged.maxBB;
+	quantError = staged.quantError;
+	lods = std::move(staged.lods);
+	arenaHandle = GeometryArena::invalidHandle;
+	vao = 0;
+	vbuf = 0;
+	ibuf = 0;
+	vcount = staged.vcount;
+	icount = staged.icount;
+	itype = staged.itype;
+	const size_t indexBytes = (size_t)icount * (itype == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint));
+
+	if (arena) {
+		arenaHandle = arena->copy(staged.vbuf, vcount, staged.ibuf, itype != GL_NONE ? indexBytes : 0);
+		staged.release();
+		return;
+	}
+	vbuf = staged.vbuf;
+	ibuf = staged.ibuf;
+	staged.vbuf = staged.ibuf = 0;
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbuf);
+	setVertexAttribs(format);
+	if (ibuf)
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibuf);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Pick the reader from the file extension, going through the binary cache if asked to
+Mesh::Geometry Mesh::readFile(const std::string& filename, bool useCache, bool optimize) {
+	Geometry geom;
+	useCache = useCache && optimize;  // blobs hold the optimized geometry
+	if (useCache && readMeshCache(filename, geom))
+		return geom;
+
+	std::string ext = std::filesystem::path(filename).extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+	if (ext == ".obj")
+		geom = readOBJ(filename);
+	else
+		geom = readPLY(filename);
+	if (optimize) {
+		buildLods(geom);
+		optimizeMesh(geom);
+	}
+
+	if (useCache)
+		writeMeshCache(filename, geom);
+	return geom;
 }
 
 // Draw the mesh
-void Mesh::draw() {
+void Mesh::draw(size_t lod) {
+	if (lods.empty())
+		return;
+	const Lod& l = lods[std::min(lod, lods.size() - 1)];
+	size_t indexSize = (itype == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+	if (arena) {
+		const GeometryArena::Range& r = arena->get(arenaHandle);
+		if (itype != GL_NONE)
+			glDrawElementsBaseVertex(GL_TRIANGLES, l.count, itype, (GLvoid*)(r.indexOffset + l.first * indexSize), r.baseVertex);
+		else
+			glDrawArrays(GL_TRIANGLES, r.baseVertex + l.first, l.count);
+		return;
+	}
 	glBindVertexArray(vao);
-	glDrawArrays(GL_TRIANGLES, 0, vcount);
+	if (ibuf) {
+		glDrawElements(GL_TRIANGLES, l.count, itype, (GLvoid*)(l.first * indexSize));
+	} else {
+		glDrawArrays(GL_TRIANGLES, l.first, l.count);
+	}
+	glBindVertexArray(0);
+}
+
+// Draw several copies of one level of detail in a single call
+void Mesh::drawInstanced(size_t lod, GLsizei instances) {
+	if (lods.empty() || instances <= 0)
+		return;
+	const Lod& l = lods[std::min(lod, lods.size() - 1)];
+	size_t indexSize = (itype == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+	if (arena) {
+		const GeometryArena::Range& r = arena->get(arenaHandle);
+		if (itype != GL_NONE)
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, l.count, itype, (GLvoid*)(r.indexOffset + l.first * indexSize), instances, r.baseVertex);
+		else
+			glDrawArraysInstanced(GL_TRIANGLES, r.baseVertex + l.first, l.count, instances);
+		return;
+	}
+	glBindVertexArray(vao);
+	if (ibuf) {
+		glDrawElementsInstanced(GL_TRIANGLES, l.count, itype, (GLvoid*)(l.first * indexSize), instances);
+	} else {
+		glDrawArraysInstanced(GL_TRIANGLES, l.first, l.count, instances);
+	}
 	glBindVertexArray(0);
 }
 
+size_t Mesh::selectLod(float pixelsPerUnit, float maxPixelError) const {
+	size_t lod = 0;
+	while (lod + 1 < lods.size() && lods[lod + 1].error * pixelsPerUnit <= maxPixelError)
+		lod++;
+	return lod;
+}
+
+glm::mat4 Mesh::positionTransform() const {
+	if (format == VERTEX_FLOAT)
+		return glm::mat4(1.0f);
+	// The normalized 16-bit positions arrive in the shader as [0, 1] fractions of the box
+	return glm::scale(glm::translate(glm::mat4(1.0f), minBB), maxBB - minBB);
+}
+
+float Mesh::octNormalScale() const {
+	switch (format) {
+	case VERTEX_COMPACT: return 1.0f / 32767.0f;
+	case VERTEX_SMALL: return 1.0f / 127.0f;
+	default: return 0.0f;
+	}
+}
+
 // Load a wavefront OBJ file
 void Mesh::loadOBJ(std::string filename, bool keepLocalGeometry) {
 	// Release resources
 	release();
 
-	std::ifstream file(filename);
-	if (!file.is_open()) {
-		std::stringstream ss;
-		ss << "Error reading " << filename << ": failed to open file";
-		throw std::runtime_error(ss.str());
-	}
+	Geometry geom = readOBJ(filename);
+	upload(geom, keepLocalGeometry);
+}
 
-	// Store vertex and normal data while reading
-	std::vector<glm::vec3> raw_vertices;
-	std::vector<glm::vec3> raw_normals;
-	std::vector<unsigned int> v_elements;
-	std::vector<unsigned int> n_elements;
-
-	std::string line;
-	while (getline(file, line)) {
-		if (line.substr(0, 2) == "v ") {
-			// Read position data
-			int index1 = indexOfNumberLetter(line, 2);
-			int index2 = lastIndexOfNumberLetter(line);
-			std::vector<std::string> values = split(line.substr(index1, index2 - index1 + 1), ' ');
-			glm::vec3 vert(stof(values[0]), stof(values[1]), stof(values[2]));
-			raw_vertices.push_back(vert);
-
-			// Update bounding box
-			minBB = glm::min(minBB, vert);
-			maxBB = glm::max(maxBB, vert);
-		} else if (line.substr(0, 3) == "vn ") {
-			// Read normal data
-			int index1 = indexOfNumberLetter(line, 2);
-			int index2 = lastIndexOfNumberLetter(line);
-			std::vector<std::string> values = split(line.substr(index1, index2 - index1 + 1), ' ');
-			raw_normals.push_back(glm::vec3(stof(values[0]), stof(values[1]), stof(values[2])));
-
-		} else if (line.substr(0, 2) == "f ") {
-			// Read face data
-			int index1 = indexOfNumberLetter(line, 2);
-			int index2 = lastIndexOfNumberLetter(line);
-			std::vector<std::string> values = split(line.substr(index1, index2 - index1 + 1), ' ');
-			for (int i = 0; i < int(values.size()) - 2; i++) {
-				// Split up vertex indices
-				std::vector<std::string> v1 = split(values[0], '/');		// Triangle fan for ngons
-				std::vector<std::string> v2 = split(values[i+1], '/');
-				std::vector<std::string> v3 = split(values[i+2], '/');
-
-				// Store position indices
-				v_elements.push_back(stoul(v1[0]) - 1);
-				v_elements.push_back(stoul(v2[0]) - 1);
-				v_elements.push_back(stoul(v3[0]) - 1);
-
-				// Check for normals
-				if (v1.size() >= 3 && v1[2].length() > 0) {
-					n_elements.push_back(stoul(v1[2]) - 1);
-					n_elements.push_back(stoul(v2[2]) - 1);
-					n_elements.push_back(stoul(v3[2]) - 1);
-				}
-			}
-		}
+// Parse a wavefront OBJ file into per-corner vertices
+Mesh::Geometry Mesh::readOBJ(const std::string& filename) {
+	Geometry geom;
+	geom.minBB = glm::vec3(std::numeric_limits<float>::max());
+	geom.maxBB = glm::vec3(std::numeric_limits<float>::lowest());
+
+	// Parse the mapped file in place
+	ObjData obj;
+	{
+		MappedFile file(filename);
+		parseOBJ(file.data(), file.end(), filename, obj);
 	}
-	file.close();
 
 	// Check if the file was invalid
-	if (raw_vertices.empty() || v_elements.empty()) {
+	if (obj.positions.empty() || obj.v_elements.empty()) {
 		std::stringstream ss;
 		ss << "Error reading " << filename << ": invalid file or no geometry";
 		throw std::runtime_error(ss.str());
 	}
 
-	// Create vertex array
-	vertices = std::vector<Vertex>(v_elements.size());
-	for (int i = 0; i < int(v_elements.size()); i += 3) {
-		// Store positions
-		vertices[i+0].pos = raw_vertices[v_elements[i+0]];
-		vertices[i+1].pos = raw_vertices[v_elements[i+1]];
-		vertices[i+2].pos = raw_vertices[v_elements[i+2]];
-
-		// Check for normals
-		if (n_elements.size() > 0) {
-			// Store normals
-			vertices[i+0].norm = raw_normals[n_elements[i+0]];
-			vertices[i+1].norm = raw_normals[n_elements[i+1]];
-			vertices[i+2].norm = raw_normals[n_elements[i+2]];
-		} else {
-			// Calculate normal
-			glm::vec3 normal = normalize(cross(vertices[i+1].pos - vertices[i+0].pos,
-				vertices[i+2].pos - vertices[i+0].pos));
-			vertices[i+0].norm = normal;
-			vertices[i+1].norm = normal;
-			vertices[i+2].norm = normal;
-		}
+	// Update bounding box
+	for (auto& vert : obj.positions) {
+		geom.minBB = glm::min(geom.minBB, vert);
+		geom.maxBB = glm::max(geom.maxBB, vert);
 	}
-	vcount = (GLsizei)vertices.size();
-
-	// Load vertices into OpenGL
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
 
-	glGenBuffers(1, &vbuf);
-	glBindBuffer(GL_ARRAY_BUFFER, vbuf);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
-
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), NULL);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)sizeof(glm::vec3));
+	// Create vertex array, in blocks of triangles spread over all cores
+	const size_t n_pos = obj.positions.size(), n_norm = obj.normals.size(), n_corner = obj.v_elements.size();
+	std::vector<Vertex>& vertices = geom.vertices;
+	vertices.resize(n_corner);
+	ThreadPool::instance().parallelFor((n_corner + cornerBlock - 1) / cornerBlock, [&](size_t block) {
+		for (size_t i = block * cornerBlock; i < std::min(n_corner, (block + 1) * cornerBlock); i += 3) {
+			const unsigned int* v = &obj.v_elements[i];
+			const int* n = &obj.n_elements[i];
+			if (v[0] >= n_pos || v[1] >= n_pos || v[2] >= n_pos) {
+				std::stringstream ss;
+				ss << "Error reading " << filename << ": vertex index out of range";
+				throw std::runtime_error(ss.str());
+			}
 
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+			// Store positions
+			vertices[i+0].pos = obj.positions[v[0]];
+			vertices[i+1].pos = obj.positions[v[1]];
+			vertices[i+2].pos = obj.positions[v[2]];
+			vertices[i+0].color = vertices[i+1].color = vertices[i+2].color = glm::vec3(0.0f);
+
+			// Check for normals
+			if (n[0] >= 0 && n[1] >= 0 && n[2] >= 0) {
+				if (size_t(n[0]) >= n_norm || size_t(n[1]) >= n_norm || size_t(n[2]) >= n_norm) {
+					std::stringstream ss;
+					ss << "Error reading " << filename << ": normal index out of range";
+					throw std::runtime_error(ss.str());
+				}
+				// Store normals
+				vertices[i+0].norm = obj.normals[n[0]];
+				vertices[i+1].norm = obj.normals[n[1]];
+				vertices[i+2].norm = obj.normals[n[2]];
+			} else {
+				// Calculate normal
+				glm::vec3 normal = normalize(cross(vertices[i+1].pos - vertices[i+0].pos,
+					vertices[i+2].pos - vertices[i+0].pos));
+				vertices[i+0].norm = normal;
+				vertices[i+1].norm = normal;
+				vertices[i+2].norm = normal;
+			}
+		}
+	});
 
-	// Delete local copy of geometry
-	if (!keepLocalGeometry)
-		vertices.clear();
+	weld(geom);
+	return geom;
 }
 
 // load a model stored in .ply format
@@ -155,146 +269,408 @@ void Mesh::loadPLY(std::string filename, bool keepLocalGeometry /* = false */) {
 	// Release resources
 	release();
 
-	std::ifstream file(filename);
-	if (!file.is_open()) {
+	Geometry geom = readPLY(filename);
+	upload(geom, keepLocalGeometry);
+}
+
+// Parse a .ply file into per-corner vertices
+Mesh::Geometry Mesh::readPLY(const std::string& filename) {
+	Geometry geom;
+	geom.minBB = glm::vec3(std::numeric_limits<float>::max());
+	geom.maxBB = glm::vec3(std::numeric_limits<float>::lowest());
+
+	// Parse the mapped file in place; the arrays are reserved from the header counts
+	PlyData ply;
+	{
+		MappedFile file(filename);
+		parsePLY(file.data(), file.end(), filename, ply);
+	}
+
+	// Check if the file was invalid
+	if (ply.vertices.empty() || ply.v_elements.empty()) {
 		std::stringstream ss;
-		ss << "Error reading " << filename << ": failed to open file";
+		ss << "Error reading " << filename << ": invalid file or no geometry";
 		throw std::runtime_error(ss.str());
 	}
 
-	// Store vertex and normal data while reading
-	std::vector<glm::vec3> raw_vertices;
-	std::vector<glm::vec3> raw_normals;
-	std::vector<unsigned int> v_elements;  // index starts from 0
-	std::vector<unsigned int> n_elements;
-	std::vector<glm::vec3> colors;  // color of each vertex; each consecutive three colors belong to the same face and should have the same color
-
-	std::string line;
-	int n_vertex, n_face;
-	// 1. read number of vertices and number of faces from ply header
-	// 2. when reaching "end_header", start reading the vertex data
-	// set up two flags
-	// flag_vertex_section: whether enter the vertex data section
-	// flag_face_section: whether enter the face data section
-	bool flag_vertex_section = false, flag_face_section = false;
-	// count the lines when we are in the vertex data section, so that we know when we will enter the face data section
-	int line_counter = 0;
-	while (getline(file, line)) {
-		if (line.find("element vertex") != std::string::npos) {
-			std::vector<std::string> values = split(line, ' ');
-			n_vertex = stoi(values[2]);
-		}
-		if (line.find("element face") != std::string::npos) {
-			std::vector<std::string> values = split(line, ' ');
-			n_face = stoi(values[2]);
-		}
-		if (line.find("end_header") != std::string::npos) {
-			flag_vertex_section = true;
-			continue;
-		}
-		if (flag_vertex_section) {
-			std::vector<std::string> values = split(line, ' ');
-			glm::vec3 vert(stof(values[0]), stof(values[1]), stof(values[2]));  // the first 3 values of this line are coordinates of the vertex
-			raw_vertices.push_back(vert);
-			raw_normals.push_back(glm::vec3(stof(values[3]), stof(values[4]), stof(values[5])));  // the last 3 values of this line are normals
-			line_counter++;
-
-			// Update bounding box
-			minBB = glm::min(minBB, vert);
-			maxBB = glm::max(maxBB, vert);
-
-			if (line_counter == n_vertex) {
-				flag_vertex_section = false;
-				flag_face_section = true;
-				continue;
-			}
-		}
-		if (flag_face_section) {
-			std::vector<std::string> values = split(line, ' ');
+	// Update bounding box
+	for (auto& vert : ply.vertices) {
+		geom.minBB = glm::min(geom.minBB, vert.pos);
+		geom.maxBB = glm::max(geom.maxBB, vert.pos);
+	}
 
-			if (stoul(values[0]) != 3) {
+	// Create vertex array, in blocks of triangles spread over all cores
+	const size_t n_vertex = ply.vertices.size(), n_corner = ply.v_elements.size();
+	std::vector<Vertex>& vertices = geom.vertices;
+	vertices.resize(n_corner);
+	ThreadPool::instance().parallelFor((n_corner + cornerBlock - 1) / cornerBlock, [&](size_t block) {
+		for (size_t i = block * cornerBlock; i < std::min(n_corner, (block + 1) * cornerBlock); i += 3) {  // traverse each face (of 3 vertices)
+			const unsigned int* v = &ply.v_elements[i];
+			if (v[0] >= n_vertex || v[1] >= n_vertex || v[2] >= n_vertex) {
 				std::stringstream ss;
-				ss << "Error reading " << filename << ": only supports triangle meshes.";
+				ss << "Error reading " << filename << ": vertex index out of range";
 				throw std::runtime_error(ss.str());
 			}
 
-			v_elements.push_back(stoul(values[1]));
-			v_elements.push_back(stoul(values[2]));
-			v_elements.push_back(stoul(values[3]));
-			n_elements.push_back(stoul(values[1]));
-			n_elements.push_back(stoul(values[2]));
-			n_elements.push_back(stoul(values[3]));
-			glm::vec3 color(
-				stof(values[4]) / 255.0,
-				stof(values[5]) / 255.0,
-				stof(values[6]) / 255.0
-			);
-			colors.push_back(color);
-			colors.push_back(color);
-			colors.push_back(color);
+			// Store positions
+			for (int k = 0; k < 3; k++)
+				vertices[i + k].pos = ply.vertices[v[k]].pos;
+
+			// Check for normals
+			if (ply.hasNormals) {
+				for (int k = 0; k < 3; k++)
+					vertices[i + k].norm = ply.vertices[v[k]].norm;
+			} else {
+				// Calculate normal
+				glm::vec3 normal = normalize(cross(vertices[i + 1].pos - vertices[i + 0].pos,
+					vertices[i + 2].pos - vertices[i + 0].pos));
+				vertices[i + 0].norm = normal;
+				vertices[i + 1].norm = normal;
+				vertices[i + 2].norm = normal;
+			}
+
+			// Colors come from the vertices or, more commonly, from the faces
+			for (int k = 0; k < 3; k++) {
+				if (!ply.vertexColors.empty())
+					vertices[i + k].color = ply.vertexColors[v[k]];
+				else if (!ply.colors.empty())
+					vertices[i + k].color = ply.colors[i / 3];
+				else
+					vertices[i + k].color = glm::vec3(0.0f);
+			}
+		}
+	});
+
+	weld(geom);
+	return geom;
+}
+
+// Hash the bit pattern of a vertex
+static inline size_t hashVertex(const Mesh::Vertex& v) {
+	uint32_t w[sizeof(Mesh::Vertex) / 4];
+	memcpy(w, &v, sizeof(w));
+	uint64_t h = 0;
+	for (uint32_t x : w)
+		h = (h ^ x) * 0x9E3779B97F4A7C15ull;
+	h ^= h >> 33;  // final mix so the low bits used by the table depend on every word
+	h *= 0xFF51AFD7ED558CCDull;
+	return size_t(h ^ (h >> 33));
+}
+
+// Weld in place: unique vertices are compacted to the front of the array as they are found.
+// Vertices are merged only when position, normal and color match exactly.
+void Mesh::weld(Geometry& geom) {
+	std::vector<Vertex>& verts = geom.vertices;
+	const size_t n_corner = verts.size();
+
+	// Hash all corners up front on all cores; the table stores the hash next to the index
+	// so most probes are resolved without touching the vertex array
+	std::vector<uint32_t> hashes(n_corner);
+	ThreadPool::instance().parallelFor((n_corner + cornerBlock - 1) / cornerBlock, [&](size_t block) {
+		for (size_t i = block * cornerBlock; i < std::min(n_corner, (block + 1) * cornerBlock); i++)
+			hashes[i] = (uint32_t)hashVertex(verts[i]);
+	});
+
+	// Open-addressing table of unique vertices, kept at most 2/3 full
+	struct Slot { uint32_t hash; GLuint index; };
+	size_t tableSize = 16;
+	while (tableSize < n_corner + n_corner / 2)
+		tableSize <<= 1;
+	const size_t mask = tableSize - 1;
+	std::vector<Slot> table(tableSize, Slot{ 0, ~GLuint(0) });
+
+	geom.indices.resize(n_corner);
+	GLuint n_unique = 0;
+	for (size_t i = 0; i < n_corner; i++) {
+		const uint32_t h = hashes[i];
+		size_t slot = h & mask;
+		while (table[slot].index != ~GLuint(0) && (table[slot].hash != h ||
+			memcmp(&verts[table[slot].index], &verts[i], sizeof(Vertex)) != 0))
+			slot = (slot + 1) & mask;
+		if (table[slot].index == ~GLuint(0)) {
+			verts[n_unique] = verts[i];
+			table[slot] = Slot{ h, n_unique++ };
 		}
+		geom.indices[i] = table[slot].index;
 	}
-	// std::cout << "num of vertex: " << n_vertex << ", num of face: " << n_face << std::endl;
-	file.close();
+	verts.resize(n_unique);
+	verts.shrink_to_fit();
+}
 
-	// Check if the file was invalid
-	if (raw_vertices.empty() || v_elements.empty()) {
-		std::stringstream ss;
-		ss << "Error reading " << filename << ": invalid file or no geometry";
-		throw std::runtime_error(ss.str());
+// GPU layouts of the compact formats. Normals are stored as plain (not normalized) integers
+// so the shader can scale them exactly; GL 3.3 maps normalized signed values asymmetrically.
+struct CompactVertex {
+	GLushort pos[3];	// Fraction of the bounding box, normalized
+	GLushort pad;		// Keeps the normal 4-byte aligned
+	GLshort norm[2];	// Octahedral normal * 32767
+	GLubyte color[4];	// RGB, normalized; the fourth byte is padding
+};
+struct SmallVertex {
+	GLushort pos[3];	// Fraction of the bounding box, normalized
+	GLbyte norm[2];		// Octahedral normal * 127
+	GLubyte color[4];	// RGB, normalized; the fourth byte is padding
+};
+static_assert(sizeof(CompactVertex) == 16 && sizeof(SmallVertex) == 12, "unexpected vertex padding");
+
+size_t Mesh::vertexSize(VertexFormat format) {
+	switch (format) {
+	case VERTEX_COMPACT: return sizeof(CompactVertex);
+	case VERTEX_SMALL: return sizeof(SmallVertex);
+	default: return sizeof(Vertex);
 	}
+}
 
-	// Create vertex array
-	vertices = std::vector<Vertex>(v_elements.size());
-	for (int i = 0; i < int(v_elements.size()); i += 3) {  // traverse each face (of 3 vertices)
-		// Store positions
-		vertices[i + 0].pos = raw_vertices[v_elements[i + 0]];
-		vertices[i + 1].pos = raw_vertices[v_elements[i + 1]];
-		vertices[i + 2].pos = raw_vertices[v_elements[i + 2]];
-
-		vertices[i + 0].color = colors[i + 0];
-		vertices[i + 1].color = colors[i + 1];
-		vertices[i + 2].color = colors[i + 2];
-
-		// Check for normals
-		if (n_elements.size() > 0) {
-			// Store normals
-			vertices[i + 0].norm = raw_normals[n_elements[i + 0]];
-			vertices[i + 1].norm = raw_normals[n_elements[i + 1]];
-			vertices[i + 2].norm = raw_normals[n_elements[i + 2]];
+// Map a unit vector onto the [-1, 1] square of the octahedral encoding
+static glm::vec2 octWrap(glm::vec3 n) {
+	float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	if (!(l1 > 0.0f))
+		return glm::vec2(0.0f);  // degenerate: +z
+	n /= l1;
+	glm::vec2 p(n.x, n.y);
+	if (n.z < 0.0f) {
+		p = glm::vec2((1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+			(1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+	}
+	return p;
+}
+
+// Inverse of octWrap, as done in the vertex shader
+static glm::vec3 octUnwrap(glm::vec2 p) {
+	glm::vec3 n(p.x, p.y, 1.0f - std::abs(p.x) - std::abs(p.y));
+	if (n.z < 0.0f) {
+		n.x = (1.0f - std::abs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f);
+		n.y = (1.0f - std::abs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return glm::normalize(n);
+}
+
+// Quantize a normal to integers in [-range, range], trying the four neighboring grid points
+// and keeping the one that decodes closest to the original. A zero-length or non-finite normal
+// becomes +z, and counts as exact.
+static void octEncode(glm::vec3 n, float range, int out[2], float& cosError) {
+	out[0] = out[1] = 0;  // +z
+	cosError = 1.0f;
+	float len = glm::length(n);
+	if (!(len > 0.0f) || !std::isfinite(len))
+		return;
+	glm::vec2 p = octWrap(n) * range;
+	glm::vec2 lo = glm::floor(p);
+	cosError = -2.0f;
+	for (int k = 0; k < 4; k++) {
+		glm::vec2 q = glm::clamp(lo + glm::vec2(k & 1, k >> 1), -range, range);
+		float c = glm::dot(octUnwrap(q / range), n);
+		if (c > cosError) {
+			cosError = c;
+			out[0] = (int)q.x;
+			out[1] = (int)q.y;
 		}
-		else {
-			// Calculate normal
-			glm::vec3 normal = normalize(cross(vertices[i + 1].pos - vertices[i + 0].pos,
-				vertices[i + 2].pos - vertices[i + 0].pos));
-			vertices[i + 0].norm = normal;
-			vertices[i + 1].norm = normal;
-			vertices[i + 2].norm = normal;
+	}
+}
+
+std::vector<unsigned char> Mesh::packVertices(const std::vector<Vertex>& vertices,
+	glm::vec3 minBB, glm::vec3 maxBB, VertexFormat format, QuantizationError* error) {
+	const size_t n = vertices.size(), stride = vertexSize(format);
+	std::vector<unsigned char> packed(n * stride);
+	if (format == VERTEX_FLOAT) {
+		if (n)
+			memcpy(packed.data(), vertices.data(), packed.size());
+		if (error)
+			*error = QuantizationError{ 0.0f, 0.0f, 0.0f };
+		return packed;
+	}
+
+	const glm::vec3 extent = maxBB - minBB;
+	const float range = (format == VERTEX_COMPACT) ? 32767.0f : 127.0f;
+	const size_t blocks = (n + cornerBlock - 1) / cornerBlock;
+	std::vector<glm::vec3> blockError(blocks, glm::vec3(0.0f));  // position, min normal cosine, color
+	ThreadPool::instance().parallelFor(blocks, [&](size_t block) {
+		float posErr = 0.0f, minCos = 1.0f, colErr = 0.0f;
+		for (size_t i = block * cornerBlock; i < std::min(n, (block + 1) * cornerBlock); i++) {
+			const Vertex& v = vertices[i];
+			GLushort pos[3];
+			GLubyte color[4] = { 0, 0, 0, 0 };
+			for (int c = 0; c < 3; c++) {
+				float t = extent[c] > 0.0f ? (v.pos[c] - minBB[c]) / extent[c] : 0.0f;
+				pos[c] = (GLushort)std::lround(glm::clamp(t, 0.0f, 1.0f) * 65535.0f);
+				posErr = std::max(posErr, std::abs(minBB[c] + pos[c] / 65535.0f * extent[c] - v.pos[c]));
+				color[c] = (GLubyte)std::lround(glm::clamp(v.color[c], 0.0f, 1.0f) * 255.0f);
+				colErr = std::max(colErr, std::abs(color[c] / 255.0f - v.color[c]));
+			}
+			int norm[2];
+			float cosError;
+			octEncode(v.norm, range, norm, cosError);
+			minCos = std::min(minCos, cosError);
+
+			unsigned char* dst = &packed[i * stride];
+			if (format == VERTEX_COMPACT) {
+				CompactVertex out;
+				memcpy(out.pos, pos, sizeof(pos));
+				out.pad = 0;
+				out.norm[0] = (GLshort)norm[0];
+				out.norm[1] = (GLshort)norm[1];
+				memcpy(out.color, color, sizeof(color));
+				memcpy(dst, &out, sizeof(out));
+			} else {
+				SmallVertex out;
+				memcpy(out.pos, pos, sizeof(pos));
+				out.norm[0] = (GLbyte)norm[0];
+				out.norm[1] = (GLbyte)norm[1];
+				memcpy(out.color, color, sizeof(color));
+				memcpy(dst, &out, sizeof(out));
+			}
+		}
+		blockError[block] = glm::vec3(posErr, minCos, colErr);
+	});
+
+	if (error) {
+		float minCos = 1.0f;
+		*error = QuantizationError{ 0.0f, 0.0f, 0.0f };
+		for (auto& e : blockError) {
+			error->position = std::max(error->position, e.x);
+			minCos = std::min(minCos, e.y);
+			error->color = std::max(error->color, e.z);
 		}
+		error->normal = glm::degrees(std::acos(glm::clamp(minCos, -1.0f, 1.0f)));
 	}
-	vcount = (GLsizei)vertices.size();
+	return packed;
+}
 
-	// Load vertices into OpenGL
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+// Use 16-bit indices when possible to halve the index buffer. Meshes where welding saves
+// nothing (e.g. flat normals computed per face) are drawn without an index buffer; their
+// corners are laid out in index order, so the LOD ranges stay valid.
+GLenum Mesh::chooseIndexType(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, VertexFormat format) {
+	const size_t indexSize = vertices.size() <= 0x10000 ? sizeof(GLushort) : sizeof(GLuint);
+	const size_t stride = vertexSize(format);
+	if (vertices.size() * stride + indices.size() * indexSize >= indices.size() * stride) {
+		if (vertices.size() != indices.size()) {
+			std::vector<Vertex> corners(indices.size());
+			for (size_t i = 0; i < indices.size(); i++)
+				corners[i] = vertices[indices[i]];
+			vertices.swap(corners);
+		}
+		indices.clear();
+		return GL_NONE;
+	}
+	return indexSize == sizeof(GLushort) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
 
-	glGenBuffers(1, &vbuf);
-	glBindBuffer(GL_ARRAY_BUFFER, vbuf);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+std::vector<unsigned char> Mesh::packIndices(const std::vector<GLuint>& indices, GLenum itype) {
+	std::vector<unsigned char> packed;
+	if (itype == GL_UNSIGNED_SHORT) {
+		packed.resize(indices.size() * sizeof(GLushort));
+		GLushort* out = (GLushort*)packed.data();
+		for (size_t i = 0; i < indices.size(); i++)
+			out[i] = (GLushort)indices[i];
+	} else if (itype == GL_UNSIGNED_INT && !indices.empty()) {
+		packed.resize(indices.size() * sizeof(GLuint));
+		memcpy(packed.data(), indices.data(), packed.size());
+	}
+	return packed;
+}
 
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), NULL);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)sizeof(glm::vec3));
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(2 * sizeof(glm::vec3)));
+// Load the geometry into OpenGL
+void Mesh::upload(Geometry& geom, bool keepLocalGeometry) {
+	minBB = geom.minBB;
+	maxBB = geom.maxBB;
+	vertices = std::move(geom.vertices);
+	indices = std::move(geom.indices);
+	lods = std::move(geom.lods);
+	if (lods.empty())
+		lods.push_back(Lod{ 0, (GLuint)indices.size(), 0.0f });
+
+	itype = chooseIndexType(vertices, indices, format);
+	vcount = (GLsizei)vertices.size();
+	icount = (GLsizei)indices.size();
+	std::vector<unsigned char> packed = packVertices(vertices, minBB, maxBB, format, &quantError);
+	std::vector<unsigned char> packedIndices = packIndices(indices, itype);
+
+	if (arena) {
+		// Suballocate from the shared buffers instead of creating our own
+		arenaHandle = arena->allocate(packed.data(), vertices.size(),
+			packedIndices.empty() ? nullptr : packedIndices.data(), packedIndices.size());
+	} else {
+		// Load vertices into OpenGL
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+
+		glGenBuffers(1, &vbuf);
+		glBindBuffer(GL_ARRAY_BUFFER, vbuf);
+		glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
+		setVertexAttribs(format);
+
+		if (itype != GL_NONE) {
+			glGenBuffers(1, &ibuf);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibuf);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, packedIndices.size(), packedIndices.data(), GL_STATIC_DRAW);
+		}
 
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
 
 	// Delete local copy of geometry
-	if (!keepLocalGeometry)
+	if (!keepLocalGeometry) {
 		vertices.clear();
+		indices.clear();
+	}
+}
+
+// Pack and upload on whatever context is current, e.g. a loader thread's
+Mesh::Staged Mesh::stage(Geometry& geom, VertexFormat format) {
+	Staged staged;
+	staged.format = format;
+	staged.minBB = geom.minBB;
+	staged.maxBB = geom.maxBB;
+	staged.lods = std::move(geom.lods);
+	if (staged.lods.empty())
+		staged.lods.push_back(Lod{ 0, (GLuint)geom.indices.size(), 0.0f });
+
+	staged.itype = chooseIndexType(geom.vertices, geom.indices, format);
+	staged.vcount = (GLsizei)geom.vertices.size();
+	staged.icount = (GLsizei)geom.indices.size();
+	std::vector<unsigned char> packed = packVertices(geom.vertices, geom.minBB, geom.maxBB, format, &staged.quantError);
+	geom.vertices = std::vector<Vertex>();
+	std::vector<unsigned char> packedIndices = packIndices(geom.indices, staged.itype);
+	geom.indices = std::vector<GLuint>();
+
+	// Through the copy-write target, since this context may have no vertex array to hold an
+	// element array binding
+	glGenBuffers(1, &staged.vbuf);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, staged.vbuf);
+	glBufferData(GL_COPY_WRITE_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
+	if (staged.itype != GL_NONE) {
+		glGenBuffers(1, &staged.ibuf);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, staged.ibuf);
+		glBufferData(GL_COPY_WRITE_BUFFER, packedIndices.size(), packedIndices.data(), GL_STATIC_DRAW);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return staged;
+}
+
+void Mesh::Staged::release() {
+	if (vbuf) { glDeleteBuffers(1, &vbuf); vbuf = 0; }
+	if (ibuf) { glDeleteBuffers(1, &ibuf); ibuf = 0; }
+}
+
+// Attribute layout of each vertex format
+void Mesh::setVertexAttribs(VertexFormat format) {
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	if (format == VERTEX_FLOAT) {
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), NULL);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)sizeof(glm::vec3));
+		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(2 * sizeof(glm::vec3)));
+	} else if (format == VERTEX_COMPACT) {
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (GLvoid*)offsetof(CompactVertex, pos));
+		glVertexAttribPointer(1, 2, GL_SHORT, GL_FALSE, sizeof(CompactVertex), (GLvoid*)offsetof(CompactVertex, norm));
+		glVertexAttribPointer(2, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(CompactVertex), (GLvoid*)offsetof(CompactVertex, color));
+	} else {
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(SmallVertex), (GLvoid*)offsetof(SmallVertex, pos));
+		glVertexAttribPointer(1, 2, GL_BYTE, GL_FALSE, sizeof(SmallVertex), (GLvoid*)offsetof(SmallVertex, norm));
+		glVertexAttribPointer(2, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(SmallVertex), (GLvoid*)offsetof(SmallVertex, color));
+	}
 }
 
 // Release resources
@@ -303,31 +679,13 @@ void Mesh::release() {
 	maxBB = glm::vec3(std::numeric_limits<float>::lowest());
 
 	vertices.clear();
+	indices.clear();
+	if (arena && arenaHandle != GeometryArena::invalidHandle) { arena->free(arenaHandle); arenaHandle = GeometryArena::invalidHandle; }
 	if (vao) { glDeleteVertexArrays(1, &vao); vao = 0; }
 	if (vbuf) { glDeleteBuffers(1, &vbuf); vbuf = 0; }
+	if (ibuf) { glDeleteBuffers(1, &ibuf); ibuf = 0; }
 	vcount = 0;
-}
-
-int indexOfNumberLetter(std::string& str, int offset) {
-	for (int i = offset; i < int(str.length()); ++i) {
-		if ((str[i] >= '0' && str[i] <= '9') || str[i] == '-' || str[i] == '.') return i;
-	}
-	return (int)str.length();
-}
-int lastIndexOfNumberLetter(std::string& str) {
-	for (int i = int(str.length()) - 1; i >= 0; --i) {
-		if ((str[i] >= '0' && str[i] <= '9') || str[i] == '-' || str[i] == '.') return i;
-	}
-	return 0;
-}
-std::vector<std::string> split(const std::string &s, char delim) {
-	std::vector<std::string> elems;
-
-	std::stringstream ss(s);
-    std::string item;
-    while (getline(ss, item, delim)) {
-        elems.push_back(item);
-    }
-
-    return elems;
+	icount = 0;
+	lods.clear();
+	quantError = QuantizationError{ 0.0f, 0.0f, 0.0f };
 }
@@ -4,12 +4,41 @@
 #include <string>
 #include <vector>
 #include <utility>
+#include <cstdint>
 #include <glm/glm.hpp>
 #include "gl_core_3_3.h"
 
+class GeometryArena;
+
 class Mesh {
 public:
-	Mesh(std::string filename, bool keepLocalGeometry = false);
+	// GPU vertex layouts. The compact ones store positions as 16-bit fractions of the bounding
+	// box, normals octahedral-encoded, and colors as 8-bit values.
+	enum VertexFormat {
+		VERTEX_FLOAT,	// 36 bytes: float position, normal, and color
+		VERTEX_COMPACT,	// 16 bytes: 16-bit position, 2x16-bit normal, 8-bit color
+		VERTEX_SMALL	// 12 bytes: 16-bit position, 2x8-bit normal, 8-bit color
+	};
+	// Largest difference between the original and the stored vertices
+	struct QuantizationError {
+		float position;	// Model-space units, largest over the three axes
+		float normal;	// Degrees
+		float color;	// Fraction of full intensity
+	};
+
+	// One level of detail: a range of the index list, drawn on its own
+	struct Lod {
+		GLuint first;	// First index
+		GLuint count;	// Number of indices
+		float error;	// Largest distance from the full-detail surface, in model units
+	};
+
+	Mesh(std::string filename, bool keepLocalGeometry = false, VertexFormat format = VERTEX_FLOAT);
+	struct Geometry;
+	Mesh(Geometry& geom, bool keepLocalGeometry = false, VertexFormat format = VERTEX_FLOAT,
+		GeometryArena* arena = nullptr);  // upload geometry read with readFile(), into the arena if given
+	struct Staged;
+	Mesh(Staged& staged, GeometryArena* arena = nullptr);  // take over staged buffers (copied into the arena if given)
 	~Mesh() { release(); }
 	// Disallow copy, move, & assignment
 	Mesh(const Mesh& other) = delete;
@@ -23,11 +52,25 @@ public:
 
 	void loadOBJ(std::string filename, bool keepLocalGeometry = false);
 	void loadPLY(std::string filename, bool keepLocalGeometry = false);
-	void draw();
+	// Draw one level of detail (clamped to the coarsest). Meshes stored in an arena draw with the
+	// arena's vertex array, which the caller binds (GeometryArena::bind) for all of them at once.
+	void draw(size_t lod = 0);
+	void drawInstanced(size_t lod, GLsizei instances);	// Draw it several times; the shader tells the copies apart by gl_InstanceID
 
-	// access:
-	inline void setModelMat(const glm::mat4 model) { modelMat = model; }
-	inline glm::mat4 getModelMat() { return modelMat; }
+	// Levels of detail, finest first
+	inline const std::vector<Lod>& getLods() const { return lods; }
+	// Coarsest level whose error stays under maxPixelError on screen, given the number of
+	// pixels one model-space unit covers at the object
+	size_t selectLod(float pixelsPerUnit, float maxPixelError = 1.0f) const;
+
+	// Vertex layout of the uploaded buffer
+	inline VertexFormat vertexFormat() const { return format; }
+	inline GeometryArena* getArena() const { return arena; }  // nullptr if the mesh owns its buffers
+	inline QuantizationError quantizationError() const { return quantError; }
+	// Maps the stored vertex positions to model space; identity for VERTEX_FLOAT
+	glm::mat4 positionTransform() const;
+	// Factor that maps the stored octahedral normal to [-1, 1], or 0 for float normals
+	float octNormalScale() const;
 
 	// Mesh vertex format
 	struct Vertex {
@@ -37,20 +80,80 @@ public:
 	};
 	// Local geometry data
 	std::vector<Vertex> vertices;
+	std::vector<GLuint> indices;	// Empty when the vertices are drawn in order
+
+	// CPU-side geometry produced by the readers, ready to be uploaded
+	struct Geometry {
+		std::vector<Vertex> vertices;	// Unique vertices
+		std::vector<GLuint> indices;	// Vertex index of each triangle corner, all levels in a row
+		std::vector<Lod> lods;			// Levels from full detail to coarsest; empty means just one
+		glm::vec3 minBB;
+		glm::vec3 maxBB;
+	};
+	// Parse a model file without touching OpenGL
+	static Geometry readOBJ(const std::string& filename);
+	static Geometry readPLY(const std::string& filename);
+	// Pick the reader from the file extension. With useCache, a valid binary cache blob of the
+	// model is loaded instead of parsing it, and a new blob is written after parsing. With
+	// optimize, the LOD chain is built (see simplify.hpp) and triangles and vertices are
+	// reordered for the GPU (see meshopt.hpp).
+	static Geometry readFile(const std::string& filename, bool useCache = true, bool optimize = true);
+	// Merge identical vertices of a per-corner vertex array and fill in the index list
+	static void weld(Geometry& geom);
+
+	// Geometry packed and uploaded into buffers of its own, possibly on another context of the
+	// same share group (e.g. a loader thread's); a Mesh built from it takes the buffers over.
+	// The buffers must not be used before the uploads have completed (e.g. a fence signaled).
+	struct Staged {
+		GLuint vbuf = 0;		// Packed vertices
+		GLuint ibuf = 0;		// Indices, 0 if the vertices are drawn in order
+		GLsizei vcount = 0;		// Number of vertices
+		GLsizei icount = 0;		// Number of indices
+		GLenum itype = GL_NONE;	// Type of the indices
+		std::vector<Lod> lods;
+		glm::vec3 minBB = glm::vec3(0.0f);
+		glm::vec3 maxBB = glm::vec3(0.0f);
+		VertexFormat format = VERTEX_FLOAT;
+		QuantizationError quantError = QuantizationError{ 0.0f, 0.0f, 0.0f };
+		void release();  // Delete the buffers, if a Mesh did not take them
+	};
+	// Pack the geometry and create its buffers on the current context. No vertex array is made,
+	// since those are not shared between contexts.
+	static Staged stage(Geometry& geom, VertexFormat format);
+
+	// Size in bytes of one vertex of a format
+	static size_t vertexSize(VertexFormat format);
+	// Point attributes 0-2 of the bound vertex array at the bound array buffer, laid out in a format
+	static void setVertexAttribs(VertexFormat format);
+	// Encode vertices in the GPU layout of a format, quantizing positions against the bounding box
+	static std::vector<unsigned char> packVertices(const std::vector<Vertex>& vertices,
+		glm::vec3 minBB, glm::vec3 maxBB, VertexFormat format, QuantizationError* error = nullptr);
 
 protected:
 	void release();		// Release OpenGL resources
+	void upload(Geometry& geom, bool keepLocalGeometry);  // Create the OpenGL buffers for the geometry
+	// Pick the index type of the geometry (GL_NONE to draw the vertices in order, in which case
+	// they are expanded to one per index) and encode the indices in it
+	static GLenum chooseIndexType(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, VertexFormat format);
+	static std::vector<unsigned char> packIndices(const std::vector<GLuint>& indices, GLenum itype);
 
 	// Bounding box
 	glm::vec3 minBB;
 	glm::vec3 maxBB;
 
-	glm::mat4 modelMat = glm::mat4(1.0f);  // the model matrix; apply this matrix to the model to transfer local coordinates to world coordinates
+	VertexFormat format;	// Layout of the vertex buffer
+	QuantizationError quantError;	// Error of the uploaded vertices (all zero for VERTEX_FLOAT)
 
 	// OpenGL resources
+	GeometryArena* arena;	// Holds the buffers instead of vao, vbuf, and ibuf, if not null
+	uint32_t arenaHandle;	// Data of this mesh in arena
 	GLuint vao;		// Vertex array object
 	GLuint vbuf;	// Vertex buffer
+	GLuint ibuf;	// Index buffer, 0 if the vertices are drawn in order
 	GLsizei vcount;	// Number of vertices
+	GLsizei icount;	// Number of indices
+	std::vector<Lod> lods;	// Index ranges, or vertex ranges without ibuf
+	GLenum itype;	// GL_UNSIGNED_SHORT if every index fits in 16 bits, else GL_UNSIGNED_INT (GL_NONE if drawn in order)
 
 private:
 };
@@ -0,0 +1,186 @@
+#define NOMINMAX
+#include "meshcache.hpp"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <cstring>
+#include <cstddef>
+#include "mapfile.hpp"
+namespace fs = std::filesystem;
+
+// Start of every cache blob. The arrays follow at 64-byte aligned offsets.
+struct MeshCacheHeader {
+	char magic[8];			// "MESHBLOB"
+	uint32_t version;		// meshCacheVersion
+	uint32_t byteOrder;		// 0x01020304 as stored by the host that wrote the blob
+	uint32_t vertexSize;	// sizeof(Mesh::Vertex)
+	uint32_t indexSize;		// sizeof(GLuint)
+	uint64_t sourceSize;	// Size of the model file in bytes
+	int64_t sourceMtime;	// Last write time of the model file
+	uint64_t sourceHash;	// hashBytes() of the model file
+	uint64_t vertexCount;
+	uint64_t indexCount;
+	uint64_t vertexOffset;	// Byte offset of the vertex array
+	uint64_t indexOffset;	// Byte offset of the index array
+	uint64_t lodCount;
+	uint64_t lodOffset;		// Byte offset of the Mesh::Lod array
+	float minBB[3];			// Bounding box
+	float maxBB[3];
+};
+
+static const char cacheMagic[8] = { 'M', 'E', 'S', 'H', 'B', 'L', 'O', 'B' };
+static const uint32_t cacheByteOrder = 0x01020304;
+static const uint64_t cacheAlign = 64;
+
+static inline uint64_t alignUp(uint64_t offset) {
+	return (offset + cacheAlign - 1) & ~(cacheAlign - 1);
+}
+
+// Last write time of a file as a plain number
+static int64_t mtimeOf(const std::string& filename) {
+	return (int64_t)fs::last_write_time(filename).time_since_epoch().count();
+}
+
+std::string meshCachePath(const std::string& filename) {
+	fs::path src(filename);
+	return (src.parent_path() / ".meshcache" / (src.filename().string() + ".mesh")).string();
+}
+
+uint64_t hashBytes(const void* data, size_t size) {
+	const unsigned char* p = (const unsigned char*)data;
+	uint64_t h = 0xCBF29CE484222325ull ^ size;
+	// Eight bytes per step
+	for (; size >= 8; p += 8, size -= 8) {
+		uint64_t w;
+		memcpy(&w, p, 8);
+		h = (h ^ w) * 0x9E3779B97F4A7C15ull;
+		h ^= h >> 31;
+	}
+	for (; size > 0; p++, size--)
+		h = (h ^ *p) * 0x100000001B3ull;
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDull;
+	return h ^ (h >> 33);
+}
+
+bool readMeshCache(const std::string& filename, Mesh::Geometry& geom) {
+	try {
+		std::string path = meshCachePath(filename);
+		std::error_code ec;
+		if (!fs::is_regular_file(path, ec))
+			return false;
+
+		MappedFile blob(path);
+		MeshCacheHeader h;
+		if (blob.size() < sizeof(h))
+			return false;
+		memcpy(&h, blob.data(), sizeof(h));
+
+		// Reject blobs from another version, build, or host
+		if (memcmp(h.magic, cacheMagic, sizeof(cacheMagic)) != 0 || h.version != meshCacheVersion ||
+			h.byteOrder != cacheByteOrder || h.vertexSize != sizeof(Mesh::Vertex) || h.indexSize != sizeof(GLuint))
+			return false;
+		if (h.vertexOffset % cacheAlign || h.indexOffset % cacheAlign ||
+			h.vertexOffset < sizeof(h) || h.vertexOffset > blob.size() || h.vertexCount > (blob.size() - h.vertexOffset) / sizeof(Mesh::Vertex) ||
+			h.indexOffset > blob.size() || h.indexCount > (blob.size() - h.indexOffset) / sizeof(GLuint) ||
+			h.lodOffset % cacheAlign || h.lodOffset > blob.size() || h.lodCount > (blob.size() - h.lodOffset) / sizeof(Mesh::Lod))
+			return false;
+		std::vector<Mesh::Lod> lods(h.lodCount);
+		if (h.lodCount)
+			memcpy(lods.data(), blob.data() + h.lodOffset, h.lodCount * sizeof(Mesh::Lod));
+		for (auto& lod : lods) {
+			if (lod.first > h.indexCount || lod.count > h.indexCount - lod.first)
+				return false;
+		}
+
+		// Reject blobs of a different source file. A changed mtime alone (e.g. after a fresh
+		// checkout) is fine as long as the contents hash the same.
+		if (h.sourceSize != fs::file_size(filename))
+			return false;
+		const int64_t mtime = mtimeOf(filename);
+		if (h.sourceMtime != mtime) {
+			{
+				MappedFile source(filename);
+				if (hashBytes(source.data(), source.size()) != h.sourceHash)
+					return false;
+			}
+			// Record the new mtime, so the next load does not hash the source again. Readers
+			// see either value, and both are valid.
+			std::fstream header(path, std::ios::binary | std::ios::in | std::ios::out);
+			header.seekp(offsetof(MeshCacheHeader, sourceMtime));
+			header.write((const char*)&mtime, sizeof(mtime));
+		}
+
+		std::vector<GLuint> indices(h.indexCount);
+		if (h.indexCount)
+			memcpy(indices.data(), blob.data() + h.indexOffset, h.indexCount * sizeof(GLuint));
+		for (GLuint index : indices) {
+			if (index >= h.vertexCount)
+				return false;  // corrupt blob: an index past the vertices would be drawn from
+		}
+
+		geom.vertices.resize(h.vertexCount);
+		memcpy(geom.vertices.data(), blob.data() + h.vertexOffset, h.vertexCount * sizeof(Mesh::Vertex));
+		geom.indices.swap(indices);
+		geom.lods.swap(lods);
+		geom.minBB = glm::vec3(h.minBB[0], h.minBB[1], h.minBB[2]);
+		geom.maxBB = glm::vec3(h.maxBB[0], h.maxBB[1], h.maxBB[2]);
+		return true;
+	} catch (const std::exception&) {
+		return false;  // unreadable blob: fall back to parsing the source
+	}
+}
+
+bool writeMeshCache(const std::string& filename, const Mesh::Geometry& geom) {
+	std::string path = meshCachePath(filename);
+	std::stringstream tmp;
+	tmp << path << ".tmp" << std::this_thread::get_id();
+	try {
+		MeshCacheHeader h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, cacheMagic, sizeof(cacheMagic));
+		h.version = meshCacheVersion;
+		h.byteOrder = cacheByteOrder;
+		h.vertexSize = sizeof(Mesh::Vertex);
+		h.indexSize = sizeof(GLuint);
+		h.sourceMtime = mtimeOf(filename);
+		{
+			MappedFile source(filename);
+			h.sourceSize = source.size();
+			h.sourceHash = hashBytes(source.data(), source.size());
+		}
+		h.vertexCount = geom.vertices.size();
+		h.indexCount = geom.indices.size();
+		h.vertexOffset = alignUp(sizeof(h));
+		h.indexOffset = alignUp(h.vertexOffset + h.vertexCount * sizeof(Mesh::Vertex));
+		h.lodCount = geom.lods.size();
+		h.lodOffset = alignUp(h.indexOffset + h.indexCount * sizeof(GLuint));
+		for (int i = 0; i < 3; i++) {
+			h.minBB[i] = geom.minBB[i];
+			h.maxBB[i] = geom.maxBB[i];
+		}
+
+		// Write to a temporary file and rename it, so a concurrent reader never sees a partial blob
+		fs::create_directories(fs::path(path).parent_path());
+		{
+			static const char zeros[cacheAlign] = {};
+			std::ofstream ostr(tmp.str(), std::ios::binary | std::ios::trunc);
+			ostr.write((const char*)&h, sizeof(h));
+			ostr.write(zeros, h.vertexOffset - sizeof(h));
+			ostr.write((const char*)geom.vertices.data(), h.vertexCount * sizeof(Mesh::Vertex));
+			ostr.write(zeros, h.indexOffset - (h.vertexOffset + h.vertexCount * sizeof(Mesh::Vertex)));
+			ostr.write((const char*)geom.indices.data(), h.indexCount * sizeof(GLuint));
+			ostr.write(zeros, h.lodOffset - (h.indexOffset + h.indexCount * sizeof(GLuint)));
+			ostr.write((const char*)geom.lods.data(), h.lodCount * sizeof(Mesh::Lod));
+			if (!ostr)
+				throw std::runtime_error("write failed");
+		}
+		fs::rename(tmp.str(), path);
+		return true;
+	} catch (const std::exception&) {
+		std::error_code ec;
+		fs::remove(tmp.str(), ec);
+		return false;  // e.g. read-only models directory; the model still loads, just uncached
+	}
+}
@@ -0,0 +1,24 @@
+#ifndef MESHCACHE_HPP
+#define MESHCACHE_HPP
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include "mesh.hpp"
+
+// Bump whenever the cache layout or the geometry produced by the readers changes
+const uint32_t meshCacheVersion = 4;
+
+// Path of the binary cache blob of a model: <model dir>/.meshcache/<model file>.mesh
+std::string meshCachePath(const std::string& filename);
+// Fill geom from the cache blob of a model if there is one and it still matches the source
+// file (same size and mtime, or same content hash). Returns false if it is missing, stale,
+// or corrupt, and leaves geom alone.
+bool readMeshCache(const std::string& filename, Mesh::Geometry& geom);
+// Write the cache blob of a model; returns false if it could not be written
+bool writeMeshCache(const std::string& filename, const Mesh::Geometry& geom);
+
+// 64-bit hash of a block of memory
+uint64_t hashBytes(const void* data, size_t size);
+
+#endif
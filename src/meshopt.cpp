@@ -0,0 +1,275 @@
+#define NOMINMAX
+#include "meshopt.hpp"
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cstdint>
+
+VertexCacheStats analyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, unsigned cacheSize) {
+	// FIFO cache: a vertex is a hit if it was transformed less than cacheSize misses ago
+	std::vector<size_t> missedAt(vertexCount, 0);	// 1 + miss counter value when last transformed
+	std::vector<char> used(vertexCount, 0);
+	size_t misses = 0, unique = 0;
+	for (GLuint v : indices) {
+		if (missedAt[v] == 0 || misses - missedAt[v] >= cacheSize) {
+			misses++;
+			missedAt[v] = misses;
+		}
+		if (!used[v]) {
+			used[v] = 1;
+			unique++;
+		}
+	}
+	VertexCacheStats stats;
+	stats.acmr = indices.empty() ? 0.0f : (float)misses / (indices.size() / 3);
+	stats.atvr = unique == 0 ? 0.0f : (float)misses / unique;
+	return stats;
+}
+
+// Scoring of Forsyth's algorithm: vertices recently used and vertices with few remaining
+// triangles score higher, so triangles are emitted around a moving front
+static const int forsythCacheSize = 32;
+
+static float vertexScore(int cachePos, unsigned remaining) {
+	if (remaining == 0)
+		return -1.0f;  // no triangle needs it any more
+	float score = 0.0f;
+	if (cachePos >= 0) {
+		if (cachePos < 3)
+			score = 0.75f;  // used by the last triangle: fixed score so strips are not favored
+		else
+			score = std::pow(1.0f - (cachePos - 3) / float(forsythCacheSize - 3), 1.5f);
+	}
+	return score + 2.0f / std::sqrt((float)remaining);
+}
+
+void optimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount) {
+	const size_t triCount = indices.size() / 3;
+	if (triCount == 0)
+		return;
+
+	// Triangles using each vertex; the live ones are kept at the front of each range
+	std::vector<uint32_t> remaining(vertexCount, 0), offsets(vertexCount + 1, 0);
+	for (GLuint v : indices)
+		remaining[v]++;
+	for (size_t v = 0; v < vertexCount; v++)
+		offsets[v + 1] = offsets[v] + remaining[v];
+	std::vector<uint32_t> adjacency(indices.size());
+	{
+		std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); i++)
+			adjacency[cursor[indices[i]]++] = (uint32_t)(i / 3);
+	}
+
+	std::vector<int> cachePos(vertexCount, -1);
+	std::vector<float> vScore(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		vScore[v] = vertexScore(-1, remaining[v]);
+	std::vector<float> tScore(triCount);
+	for (size_t t = 0; t < triCount; t++)
+		tScore[t] = vScore[indices[3 * t]] + vScore[indices[3 * t + 1]] + vScore[indices[3 * t + 2]];
+	std::vector<char> emitted(triCount, 0);
+
+	std::vector<GLuint> out;
+	out.reserve(indices.size());
+	std::vector<GLuint> cache, newCache;
+	cache.reserve(forsythCacheSize + 3);
+	newCache.reserve(forsythCacheSize + 3);
+
+	size_t best = std::max_element(tScore.begin(), tScore.end()) - tScore.begin();
+	size_t scan = 0;  // every triangle before this one has been emitted
+	while (true) {
+		// Emit the triangle and take it out of its vertices' lists
+		emitted[best] = 1;
+		const GLuint* tri = &indices[3 * best];
+		for (int k = 0; k < 3; k++) {
+			GLuint v = tri[k];
+			out.push_back(v);
+			uint32_t* list = &adjacency[offsets[v]];
+			uint32_t* pos = std::find(list, list + remaining[v], (uint32_t)best);
+			std::swap(*pos, list[remaining[v] - 1]);
+			remaining[v]--;
+		}
+		if (out.size() == indices.size())
+			break;
+
+		// Move its vertices to the front of the LRU cache
+		newCache.assign(tri, tri + 3);
+		for (GLuint v : cache) {
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+				newCache.push_back(v);
+		}
+		cache.swap(newCache);
+
+		// Rescore the touched vertices and their triangles, and pick the best of those
+		float bestScore = -1e30f;
+		best = triCount;
+		for (size_t i = 0; i < cache.size(); i++) {
+			GLuint v = cache[i];
+			cachePos[v] = i < (size_t)forsythCacheSize ? (int)i : -1;  // the tail was pushed out
+			float score = vertexScore(cachePos[v], remaining[v]);
+			float delta = score - vScore[v];
+			vScore[v] = score;
+			const uint32_t* list = &adjacency[offsets[v]];
+			for (uint32_t j = 0; j < remaining[v]; j++)
+				tScore[list[j]] += delta;
+		}
+		for (size_t i = 0; i < std::min(cache.size(), (size_t)forsythCacheSize); i++) {
+			GLuint v = cache[i];
+			const uint32_t* list = &adjacency[offsets[v]];
+			for (uint32_t j = 0; j < remaining[v]; j++) {
+				if (tScore[list[j]] > bestScore) {
+					bestScore = tScore[list[j]];
+					best = list[j];
+				}
+			}
+		}
+		if (cache.size() > (size_t)forsythCacheSize)
+			cache.resize(forsythCacheSize);
+
+		// Nothing in the cache has triangles left: continue with the next unemitted triangle
+		if (best == triCount) {
+			while (emitted[scan])
+				scan++;
+			best = scan;
+		}
+	}
+	indices.swap(out);
+}
+
+void optimizeOverdraw(std::vector<GLuint>& indices, const std::vector<Mesh::Vertex>& vertices, float threshold) {
+	const size_t triCount = indices.size() / 3;
+	if (triCount < 2)
+		return;
+
+	// Cache misses of each triangle, simulating from a cold cache at every cluster start
+	std::vector<size_t> missedAt(vertices.size(), 0);
+	size_t misses = 0, epoch = 0;
+	auto triMisses = [&](size_t t) {
+		unsigned m = 0;
+		for (int k = 0; k < 3; k++) {
+			GLuint v = indices[3 * t + k];
+			if (missedAt[v] <= epoch || misses - missedAt[v] >= vertexCacheSize) {
+				missedAt[v] = ++misses;
+				m++;
+			}
+		}
+		return m;
+	};
+	auto resetCache = [&]() { epoch = misses; };
+
+	// Hard boundaries: triangles where all three vertices missed, i.e. the cache restarted
+	std::vector<size_t> hard;
+	for (size_t t = 0; t < triCount; t++) {
+		if (triMisses(t) == 3)
+			hard.push_back(t);
+	}
+	if (hard.empty() || hard[0] != 0)
+		hard.insert(hard.begin(), 0);
+	hard.push_back(triCount);
+
+	// Soft boundaries: cut a hard cluster early once its running ACMR is close to its total
+	std::vector<size_t> clusters;
+	for (size_t c = 0; c + 1 < hard.size(); c++) {
+		size_t begin = hard[c], end = hard[c + 1];
+		resetCache();
+		size_t clusterMisses = 0;
+		for (size_t t = begin; t < end; t++)
+			clusterMisses += triMisses(t);
+		float clusterAcmr = (float)clusterMisses / (end - begin);
+
+		resetCache();
+		size_t start = begin, running = 0;
+		clusters.push_back(begin);
+		for (size_t t = begin; t < end; t++) {
+			running += triMisses(t);
+			if (t + 1 < end && (float)running / (t + 1 - start) <= clusterAcmr * threshold) {
+				clusters.push_back(t + 1);
+				start = t + 1;
+				running = 0;
+				resetCache();
+			}
+		}
+	}
+	clusters.push_back(triCount);
+
+	// Sort clusters by how far they face away from the mesh center, outermost first
+	glm::vec3 meshCenter(0.0f);
+	float meshArea = 0.0f;
+	const size_t clusterCount = clusters.size() - 1;
+	std::vector<glm::vec3> centers(clusterCount), normals(clusterCount);
+	std::vector<float> areas(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++) {
+		glm::vec3 center(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+			const glm::vec3& a = vertices[indices[3 * t]].pos;
+			const glm::vec3& b = vertices[indices[3 * t + 1]].pos;
+			const glm::vec3& d = vertices[indices[3 * t + 2]].pos;
+			glm::vec3 n = glm::cross(b - a, d - a);
+			float w = glm::length(n);
+			center += (a + b + d) * (w / 3.0f);
+			normal += n;
+			area += w;
+		}
+		meshCenter += center;
+		meshArea += area;
+		centers[c] = area > 0.0f ? center / area : glm::vec3(0.0f);
+		float len = glm::length(normal);
+		normals[c] = len > 0.0f ? normal / len : glm::vec3(0.0f);
+		areas[c] = area;
+	}
+	if (meshArea > 0.0f)
+		meshCenter /= meshArea;
+	std::vector<float> sortKey(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+		sortKey[c] = areas[c] > 0.0f ? glm::dot(centers[c] - meshCenter, normals[c]) : 0.0f;
+	std::vector<size_t> order(clusterCount);
+	std::iota(order.begin(), order.end(), size_t(0));
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+	std::vector<GLuint> out;
+	out.reserve(indices.size());
+	for (size_t c : order)
+		out.insert(out.end(), indices.begin() + 3 * clusters[c], indices.begin() + 3 * clusters[c + 1]);
+	indices.swap(out);
+}
+
+void optimizeVertexFetch(Mesh::Geometry& geom) {
+	const GLuint unused = ~GLuint(0);
+	std::vector<GLuint> remap(geom.vertices.size(), unused);
+	std::vector<Mesh::Vertex> vertices;
+	vertices.reserve(geom.vertices.size());
+	for (GLuint& v : geom.indices) {
+		if (remap[v] == unused) {
+			remap[v] = (GLuint)vertices.size();
+			vertices.push_back(geom.vertices[v]);
+		}
+		v = remap[v];
+	}
+	geom.vertices.swap(vertices);
+}
+
+// Reorder one index list for the cache and overdraw, keeping the input order if the result
+// misses the cache as often or more (e.g. a list already laid out well by the exporter)
+static void optimizeTriangles(std::vector<GLuint>& indices, const std::vector<Mesh::Vertex>& vertices) {
+	std::vector<GLuint> reordered(indices);
+	optimizeVertexCache(reordered, vertices.size());
+	optimizeOverdraw(reordered, vertices);
+	if (analyzeVertexCache(reordered, vertices.size()).acmr < analyzeVertexCache(indices, vertices.size()).acmr)
+		indices.swap(reordered);
+}
+
+void optimizeMesh(Mesh::Geometry& geom) {
+	if (geom.lods.empty()) {
+		optimizeTriangles(geom.indices, geom.vertices);
+	} else {
+		for (const Mesh::Lod& lod : geom.lods) {
+			auto begin = geom.indices.begin() + lod.first;
+			std::vector<GLuint> range(begin, begin + lod.count);
+			optimizeTriangles(range, geom.vertices);
+			std::copy(range.begin(), range.end(), begin);
+		}
+	}
+	optimizeVertexFetch(geom);
+}
@@ -0,0 +1,33 @@
+#ifndef MESHOPT_HPP
+#define MESHOPT_HPP
+
+#include <vector>
+#include <cstddef>
+#include "mesh.hpp"
+
+// Size of the FIFO post-transform cache simulated by analyzeVertexCache
+const unsigned vertexCacheSize = 16;
+
+// Result of simulating the post-transform vertex cache over an index list
+struct VertexCacheStats {
+	float acmr;		// Average cache miss ratio: transformed vertices per triangle (0.5 - 3)
+	float atvr;		// Average transformed vertex ratio: transformed vertices per unique vertex (>= 1)
+};
+VertexCacheStats analyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount,
+	unsigned cacheSize = vertexCacheSize);
+
+// Reorder triangles for post-transform cache locality (Forsyth's linear-speed algorithm)
+void optimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount);
+// Split a cache-optimized index list into clusters and sort them so outward-facing clusters are
+// drawn first, reducing overdraw. Clusters end where the cache restarts or where cutting them
+// keeps the ACMR within threshold times the cluster's own.
+void optimizeOverdraw(std::vector<GLuint>& indices, const std::vector<Mesh::Vertex>& vertices,
+	float threshold = 1.05f);
+// Renumber vertices in the order the index list first uses them, dropping unused ones
+void optimizeVertexFetch(Mesh::Geometry& geom);
+
+// All three passes in order, as run at load time. Each level of detail is reordered on its own,
+// and keeps its triangle order if reordering does not lower its ACMR.
+void optimizeMesh(Mesh::Geometry& geom);
+
+#endif
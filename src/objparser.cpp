@@ -0,0 +1,144 @@
+#define NOMINMAX
+#include "objparser.hpp"
+#include "textscan.hpp"
+#include "threadpool.hpp"
+
+// Records of one chunk of the file. Negative (relative) indices are resolved against the
+// chunk's own counts, and the corners holding them are listed so the merge can shift them.
+struct ObjChunk : ObjData {
+	std::vector<size_t> v_relative;		// Corners with a relative position index
+	std::vector<size_t> n_relative;		// Corners with a relative normal index
+};
+
+// Parse one face corner ("v", "v/t", "v//n" or "v/t/n"); n is left at 0 when there is no normal
+static bool parseCorner(const char*& p, const char* end, long& v, long& n) {
+	n = 0;
+	if (!parseInt(p, end, v))
+		return false;
+	if (p < end && *p == '/') {
+		++p;
+		long t;  // texture coordinates are not used
+		if (p < end && *p != '/' && !parseInt(p, end, t))
+			return false;
+		if (p < end && *p == '/') {
+			++p;
+			if (!parseInt(p, end, n))
+				return false;
+		}
+	}
+	return p == end || isBlank(*p);
+}
+
+// Parse the lines in [p, end); "begin" is the start of the file (for line numbers in errors)
+static void parseChunk(const char* begin, const char* p, const char* end, const std::string& filename, ObjChunk& out) {
+	while (p < end) {
+		const char* eol = findLineEnd(p, end);
+		const char* q = skipBlanks(p, eol);
+		size_t len = eol - q;
+
+		if (len > 1 && q[0] == 'v' && isBlank(q[1])) {
+			// Read position data
+			glm::vec3 vert;
+			q += 2;
+			if (!parseFloat(q, eol, vert.x) || !parseFloat(q, eol, vert.y) || !parseFloat(q, eol, vert.z))
+				parseError(filename, begin, q, "malformed vertex");
+			out.positions.push_back(vert);
+		} else if (len > 2 && q[0] == 'v' && q[1] == 'n' && isBlank(q[2])) {
+			// Read normal data
+			glm::vec3 norm;
+			q += 3;
+			if (!parseFloat(q, eol, norm.x) || !parseFloat(q, eol, norm.y) || !parseFloat(q, eol, norm.z))
+				parseError(filename, begin, q, "malformed normal");
+			out.normals.push_back(norm);
+		} else if (len > 1 && q[0] == 'f' && isBlank(q[1])) {
+			// Read face data; ngons become a triangle fan around the first corner
+			long v0 = 0, n0 = -1, v1 = 0, n1 = -1;
+			bool rv0 = false, rn0 = false, rv1 = false, rn1 = false;  // whether the index was relative
+			int corners = 0;
+			q += 2;
+			while (true) {
+				q = skipBlanks(q, eol);
+				if (q == eol || *q == '#')
+					break;
+				long v, n;
+				if (!parseCorner(q, eol, v, n) || v == 0)
+					parseError(filename, begin, q, "malformed face");
+				// 1-based, or relative to the records read so far
+				bool rv = v < 0, rn = n < 0;
+				v = rv ? (long)out.positions.size() + v : v - 1;
+				n = rn ? (long)out.normals.size() + n : n - 1;  // -1 when there is no normal
+
+				if (corners >= 2) {
+					const long vs[3] = { v0, v1, v }, ns[3] = { n0, n1, n };
+					const bool rvs[3] = { rv0, rv1, rv }, rns[3] = { rn0, rn1, rn };
+					for (int k = 0; k < 3; k++) {
+						if (rvs[k]) out.v_relative.push_back(out.v_elements.size());
+						if (rns[k]) out.n_relative.push_back(out.n_elements.size());
+						out.v_elements.push_back((unsigned int)vs[k]);
+						out.n_elements.push_back((int)ns[k]);
+					}
+				} else if (corners == 0) {
+					v0 = v; n0 = n; rv0 = rv; rn0 = rn;
+				}
+				v1 = v; n1 = n; rv1 = rv; rn1 = rn;
+				corners++;
+			}
+			if (corners < 3)
+				parseError(filename, begin, q, "face with fewer than 3 vertices");
+		}
+		p = eol + 1;
+	}
+}
+
+void parseOBJ(const char* begin, const char* end, const std::string& filename, ObjData& out) {
+	// Parse chunks of whole lines on all cores
+	ThreadPool& pool = ThreadPool::instance();
+	std::vector<const char*> bounds = splitAtLines(begin, end, 1 << 20, 4 * pool.concurrency());
+	std::vector<ObjChunk> chunks(bounds.size() - 1);
+	pool.parallelFor(chunks.size(), [&](size_t i) {
+		parseChunk(begin, bounds[i], bounds[i + 1], filename, chunks[i]);
+	});
+
+	// Where each chunk goes in the merged arrays
+	std::vector<size_t> posBase(chunks.size()), normBase(chunks.size()), elemBase(chunks.size());
+	size_t n_pos = out.positions.size(), n_norm = out.normals.size(), n_elem = out.v_elements.size();
+	for (size_t i = 0; i < chunks.size(); i++) {
+		posBase[i] = n_pos;
+		normBase[i] = n_norm;
+		elemBase[i] = n_elem;
+		n_pos += chunks[i].positions.size();
+		n_norm += chunks[i].normals.size();
+		n_elem += chunks[i].v_elements.size();
+	}
+	out.positions.resize(n_pos);
+	out.normals.resize(n_norm);
+	out.v_elements.resize(n_elem);
+	out.n_elements.resize(n_elem);
+
+	// Copy the chunks into place and rebase their relative indices
+	pool.parallelFor(chunks.size(), [&](size_t i) {
+		ObjChunk& c = chunks[i];
+		std::copy(c.positions.begin(), c.positions.end(), out.positions.begin() + posBase[i]);
+		std::copy(c.normals.begin(), c.normals.end(), out.normals.begin() + normBase[i]);
+		std::copy(c.v_elements.begin(), c.v_elements.end(), out.v_elements.begin() + elemBase[i]);
+		std::copy(c.n_elements.begin(), c.n_elements.end(), out.n_elements.begin() + elemBase[i]);
+		for (size_t k : c.v_relative) {
+			long v = (long)(int)c.v_elements[k] + (long)posBase[i];
+			if (v < 0) {
+				std::stringstream ss;
+				ss << "Error reading " << filename << ": relative vertex index before the first vertex";
+				throw std::runtime_error(ss.str());
+			}
+			out.v_elements[elemBase[i] + k] = (unsigned int)v;
+		}
+		for (size_t k : c.n_relative) {
+			long n = (long)c.n_elements[k] + (long)normBase[i];
+			if (n < 0) {
+				std::stringstream ss;
+				ss << "Error reading " << filename << ": relative normal index before the first normal";
+				throw std::runtime_error(ss.str());
+			}
+			out.n_elements[elemBase[i] + k] = (int)n;
+		}
+	});
+}
@@ -0,0 +1,21 @@
+#ifndef OBJPARSER_HPP
+#define OBJPARSER_HPP
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Raw contents of a wavefront OBJ file, with faces triangulated as fans
+struct ObjData {
+	std::vector<glm::vec3> positions;		// "v" records
+	std::vector<glm::vec3> normals;			// "vn" records
+	std::vector<unsigned int> v_elements;	// position index of each triangle corner (0-based)
+	std::vector<int> n_elements;			// normal index of each triangle corner, -1 if the face has none
+};
+
+// Parse the OBJ text in [begin, end) and append the records to "out".
+// Numbers are parsed in place; nothing is allocated per line. Large files are split into
+// chunks of whole lines that are parsed on all cores and merged back in file order.
+void parseOBJ(const char* begin, const char* end, const std::string& filename, ObjData& out);
+
+#endif
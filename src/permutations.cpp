@@ -0,0 +1,74 @@
+#define NOMINMAX
+#include "permutations.hpp"
+#include <algorithm>
+
+// Macro defined by each feature bit, in bit order
+static const char* featureMacros[ShaderPermutations::featureCount] = { "USE_NORMALS", "OCT_NORMALS" };
+
+uint32_t ShaderPermutations::featuresFor(Mesh::VertexFormat format, bool normals) {
+	// Without normals their encoding does not matter, so both formats share the variant
+	if (!normals)
+		return 0;
+	return FEATURE_NORMALS | (format == Mesh::VERTEX_FLOAT ? 0 : FEATURE_OCT_NORMALS);
+}
+
+std::string ShaderPermutations::defines(uint32_t features) {
+	std::string text;
+	for (int i = 0; i < featureCount; i++) {
+		if (features & (1u << i))
+			text += std::string("#define ") + featureMacros[i] + "\n";
+	}
+	return text;
+}
+
+std::string ShaderPermutations::describe(uint32_t features) {
+	std::string text;
+	for (int i = 0; i < featureCount; i++) {
+		if (features & (1u << i))
+			text += (text.empty() ? "" : " ") + std::string(featureMacros[i]);
+	}
+	return text.empty() ? "no features" : text;
+}
+
+ShaderProgram& ShaderPermutations::get(uint32_t features) {
+	std::unique_ptr<ShaderProgram>& program = programs[features];
+	if (!program) {
+		program = std::unique_ptr<ShaderProgram>(new ShaderProgram());
+		for (const Stage& s : stages)
+			program->addStage(s.type, s.filename);
+		program->setOnLink(onLink);
+		program->setUniforms(uniformNames);
+		program->setCacheDir(cacheDir);
+		program->setDefines(defines(features));
+		program->submit();
+	}
+	return *program;
+}
+
+std::vector<uint32_t> ShaderPermutations::poll() {
+	std::vector<uint32_t> ready;
+	for (auto& p : programs) {
+		if (p.second->poll())
+			ready.push_back(p.first);
+	}
+	return ready;
+}
+
+bool ShaderPermutations::reload(const std::vector<std::string>& changedFiles) {
+	bool replaced = false;
+	for (auto& p : programs) {
+		ShaderProgram& program = *p.second;
+		bool affected = std::any_of(changedFiles.begin(), changedFiles.end(), [&](const std::string& f) { return program.uses(f); });
+		if (affected && program.reload(changedFiles))
+			replaced = true;
+	}
+	return replaced;
+}
+
+bool ShaderPermutations::isPending() const {
+	for (const auto& p : programs) {
+		if (p.second->getState() == ShaderProgram::STATE_PENDING)
+			return true;
+	}
+	return false;
+}
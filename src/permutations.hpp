@@ -0,0 +1,68 @@
+#ifndef PERMUTATIONS_HPP
+#define PERMUTATIONS_HPP
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include "shader.hpp"
+#include "mesh.hpp"
+
+// Variants of one shader program specialized at compile time. Each feature bit defines a
+// macro ahead of the source, so a variant only pays for the inputs and code its meshes use.
+// A variant is compiled the first time it is asked for and kept by its features.
+class ShaderPermutations {
+public:
+	enum Feature {
+		FEATURE_NORMALS = 1 << 0,		// USE_NORMALS: normals are read and shaded with
+		FEATURE_OCT_NORMALS = 1 << 1,	// OCT_NORMALS: they are octahedral-encoded
+	};
+	static const int featureCount = 2;
+
+	ShaderPermutations() {}
+	// Disallow copy, move, & assignment
+	ShaderPermutations(const ShaderPermutations& other) = delete;
+	ShaderPermutations& operator=(const ShaderPermutations& other) = delete;
+	ShaderPermutations(ShaderPermutations&& other) = delete;
+	ShaderPermutations& operator=(ShaderPermutations&& other) = delete;
+
+	// Stages, link hook, and cache directory of every variant; set before the first get()
+	inline void addStage(GLenum type, const std::string& filename) { stages.push_back(Stage{ type, filename }); }
+	inline void setOnLink(const std::function<void(GLuint)>& fn) { onLink = fn; }
+	inline void setUniforms(const std::vector<std::string>& names) { uniformNames = names; }
+	inline void setCacheDir(const std::string& dir) { cacheDir = dir; }
+
+	// The fewest features that draw meshes of a vertex format, with or without normals
+	static uint32_t featuresFor(Mesh::VertexFormat format, bool normals);
+	// The #define lines of a set of features, and their names for messages
+	static std::string defines(uint32_t features);
+	static std::string describe(uint32_t features);
+
+	// The variant with the given features, submitted for compiling if it is new. It is drawn
+	// with once it is ready (see poll()).
+	ShaderProgram& get(uint32_t features);
+	// Collect the variants the driver finished compiling; returns the features of those that
+	// just became ready
+	std::vector<uint32_t> poll();
+	// Rebuild the variants that read any of the given files; returns whether any was replaced
+	bool reload(const std::vector<std::string>& changedFiles);
+
+	// access:
+	bool isPending() const;		// Whether any variant is still compiling
+	inline size_t size() const { return programs.size(); }
+
+protected:
+	struct Stage {
+		GLenum type;
+		std::string filename;
+	};
+	std::vector<Stage> stages;
+	std::function<void(GLuint)> onLink;
+	std::vector<std::string> uniformNames;
+	std::string cacheDir;
+	std::map<uint32_t, std::unique_ptr<ShaderProgram>> programs;	// By features
+};
+
+#endif
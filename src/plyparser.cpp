@@ -0,0 +1,733 @@
+#define NOMINMAX
+#include "plyparser.hpp"
+#include "textscan.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <cstdint>
+
+// Map a PLY type name (either spelling) to its type
+static PlyType plyType(const char* tok, const char* tokEnd) {
+	std::string name(tok, tokEnd);
+	if (name == "char" || name == "int8") return PLY_CHAR;
+	if (name == "uchar" || name == "uint8") return PLY_UCHAR;
+	if (name == "short" || name == "int16") return PLY_SHORT;
+	if (name == "ushort" || name == "uint16") return PLY_USHORT;
+	if (name == "int" || name == "int32") return PLY_INT;
+	if (name == "uint" || name == "uint32") return PLY_UINT;
+	if (name == "float" || name == "float32") return PLY_FLOAT;
+	if (name == "double" || name == "float64") return PLY_DOUBLE;
+	return PLY_NONE;
+}
+
+// Role of a property of the vertex or face element
+static PlyField plyField(const std::string& element, const std::string& name) {
+	if (element == "vertex") {
+		if (name == "x") return PLY_FIELD_X;
+		if (name == "y") return PLY_FIELD_Y;
+		if (name == "z") return PLY_FIELD_Z;
+		if (name == "nx") return PLY_FIELD_NX;
+		if (name == "ny") return PLY_FIELD_NY;
+		if (name == "nz") return PLY_FIELD_NZ;
+	} else if (element == "face") {
+		if (name == "vertex_indices" || name == "vertex_index") return PLY_FIELD_INDICES;
+	} else {
+		return PLY_FIELD_NONE;
+	}
+	if (name == "red" || name == "diffuse_red") return PLY_FIELD_RED;
+	if (name == "green" || name == "diffuse_green") return PLY_FIELD_GREEN;
+	if (name == "blue" || name == "diffuse_blue") return PLY_FIELD_BLUE;
+	return PLY_FIELD_NONE;
+}
+
+// Move p to the start of the next line
+static const char* nextLine(const char* p, const char* end) {
+	p = findLineEnd(p, end);
+	return (p < end) ? p + 1 : end;
+}
+
+PlyHeader parsePLYHeader(const char* begin, const char* end, const std::string& filename) {
+	PlyHeader header;
+	header.format = PLY_ASCII;
+	header.size = 0;
+
+	const char* p = begin;
+	bool first = true;
+	while (p < end) {
+		const char* eol = findLineEnd(p, end);
+		// Split the line into whitespace-separated words as they are needed
+		const char* q = p;
+		auto word = [&](const char*& tokEnd) {
+			const char* tok = skipBlanks(q, eol);
+			tokEnd = skipToken(tok, eol);
+			q = tokEnd;
+			return tok;
+		};
+		const char* kwEnd;
+		const char* kw = word(kwEnd);
+		std::string keyword(kw, kwEnd);
+
+		if (first) {
+			if (keyword != "ply")
+				parseError(filename, begin, p, "not a PLY file");
+			first = false;
+		} else if (keyword == "format") {
+			const char* tokEnd;
+			const char* tok = word(tokEnd);
+			std::string format(tok, tokEnd);
+			if (format == "ascii") header.format = PLY_ASCII;
+			else if (format == "binary_little_endian") header.format = PLY_BINARY_LE;
+			else if (format == "binary_big_endian") header.format = PLY_BINARY_BE;
+			else parseError(filename, begin, p, "unknown format");
+		} else if (keyword == "element") {
+			PlyElement elem;
+			const char* tokEnd;
+			const char* tok = word(tokEnd);
+			elem.name = std::string(tok, tokEnd);
+			long count;
+			if (!parseInt(q, eol, count) || count < 0)
+				parseError(filename, begin, p, "malformed element");
+			elem.count = (size_t)count;
+			header.elements.push_back(elem);
+		} else if (keyword == "property") {
+			if (header.elements.empty())
+				parseError(filename, begin, p, "property outside of an element");
+			PlyProperty prop;
+			const char* tokEnd;
+			const char* tok = word(tokEnd);
+			if (std::string(tok, tokEnd) == "list") {
+				tok = word(tokEnd);
+				prop.countType = plyType(tok, tokEnd);
+				tok = word(tokEnd);
+				prop.type = plyType(tok, tokEnd);
+				if (prop.countType == PLY_NONE || prop.countType == PLY_FLOAT || prop.countType == PLY_DOUBLE)
+					parseError(filename, begin, p, "malformed list property");
+			} else {
+				prop.countType = PLY_NONE;
+				prop.type = plyType(tok, tokEnd);
+			}
+			if (prop.type == PLY_NONE)
+				parseError(filename, begin, p, "unknown property type");
+			tok = word(tokEnd);
+			prop.name = std::string(tok, tokEnd);
+			prop.field = plyField(header.elements.back().name, prop.name);
+			if ((prop.field == PLY_FIELD_INDICES) != (prop.countType != PLY_NONE))
+				prop.field = PLY_FIELD_NONE;  // only the index list may be a list
+			header.elements.back().properties.push_back(prop);
+		} else if (keyword == "end_header") {
+			header.size = nextLine(eol, end) - begin;
+			return header;
+		}
+		// "comment", "obj_info" and anything unknown are ignored
+		p = nextLine(eol, end);
+	}
+	parseError(filename, begin, p, "missing end_header");
+}
+
+
+// Size in bytes of a binary value
+static size_t plyTypeSize(PlyType type) {
+	switch (type) {
+	case PLY_CHAR: case PLY_UCHAR: return 1;
+	case PLY_SHORT: case PLY_USHORT: return 2;
+	case PLY_INT: case PLY_UINT: case PLY_FLOAT: return 4;
+	case PLY_DOUBLE: return 8;
+	default: return 0;
+	}
+}
+
+// Value of a full-intensity color channel stored with the given type
+static double colorRange(PlyType type) {
+	switch (type) {
+	case PLY_FLOAT: case PLY_DOUBLE: return 1.0;
+	case PLY_SHORT: case PLY_USHORT: return 65535.0;
+	default: return 255.0;
+	}
+}
+
+static bool hostIsLittleEndian() {
+	const uint16_t one = 1;
+	return *(const uint8_t*)&one == 1;
+}
+
+// Reverse the byte order of n consecutive 4-byte words in place (the compiler turns this into bswap/shuffles)
+static void swapBytes32(void* data, size_t n) {
+	uint32_t* w = (uint32_t*)data;
+	for (size_t i = 0; i < n; i++) {
+		uint32_t x = w[i];
+		w[i] = (x >> 24) | ((x >> 8) & 0x0000ff00u) | ((x << 8) & 0x00ff0000u) | (x << 24);
+	}
+}
+
+// Load a binary value whose type is known at compile time
+template<typename T, bool Swap>
+static inline T load(const char* p) {
+	T v;
+	if constexpr (Swap) {
+		char b[sizeof(T)];
+		for (size_t i = 0; i < sizeof(T); i++)
+			b[i] = p[sizeof(T) - 1 - i];
+		memcpy(&v, b, sizeof(T));
+	} else {
+		memcpy(&v, p, sizeof(T));
+	}
+	return v;
+}
+
+// Load a binary value whose type is only known at run time, converting it to double
+static double readBinary(const char* p, PlyType type, bool swap) {
+	unsigned char b[8];
+	size_t size = plyTypeSize(type);
+	memcpy(b, p, size);
+	if (swap)
+		std::reverse(b, b + size);
+	switch (type) {
+	case PLY_CHAR: { int8_t v; memcpy(&v, b, 1); return v; }
+	case PLY_UCHAR: { uint8_t v; memcpy(&v, b, 1); return v; }
+	case PLY_SHORT: { int16_t v; memcpy(&v, b, 2); return v; }
+	case PLY_USHORT: { uint16_t v; memcpy(&v, b, 2); return v; }
+	case PLY_INT: { int32_t v; memcpy(&v, b, 4); return v; }
+	case PLY_UINT: { uint32_t v; memcpy(&v, b, 4); return v; }
+	case PLY_FLOAT: { float v; memcpy(&v, b, 4); return v; }
+	case PLY_DOUBLE: { double v; memcpy(&v, b, 8); return v; }
+	default: return 0.0;
+	}
+}
+
+// Whether the element has a property with the given role
+static bool hasField(const PlyElement& elem, PlyField field) {
+	for (auto& prop : elem.properties) {
+		if (prop.field == field)
+			return true;
+	}
+	return false;
+}
+
+// Whether the element's properties are exactly these roles and types, in this order
+static bool hasLayout(const PlyElement& elem, const PlyField* fields, const PlyType* types, size_t n) {
+	if (elem.properties.size() != n)
+		return false;
+	for (size_t i = 0; i < n; i++) {
+		if (elem.properties[i].field != fields[i] || elem.properties[i].type != types[i])
+			return false;
+	}
+	return true;
+}
+
+// Vertex records of the form float x y z [float nx ny nz] [uchar red green blue]
+static bool isCommonVertexLayout(const PlyElement& elem, bool& normals, bool& colors) {
+	static const PlyField fields[9] = { PLY_FIELD_X, PLY_FIELD_Y, PLY_FIELD_Z, PLY_FIELD_NX, PLY_FIELD_NY, PLY_FIELD_NZ,
+		PLY_FIELD_RED, PLY_FIELD_GREEN, PLY_FIELD_BLUE };
+	static const PlyType types[9] = { PLY_FLOAT, PLY_FLOAT, PLY_FLOAT, PLY_FLOAT, PLY_FLOAT, PLY_FLOAT,
+		PLY_UCHAR, PLY_UCHAR, PLY_UCHAR };
+	for (int variant = 0; variant < 4; variant++) {
+		normals = (variant & 1) != 0;
+		colors = (variant & 2) != 0;
+		PlyField f[9];
+		PlyType t[9];
+		size_t n = 0;
+		for (int k = 0; k < 9; k++) {
+			if ((k >= 3 && k < 6 && !normals) || (k >= 6 && !colors))
+				continue;
+			f[n] = fields[k];
+			t[n] = types[k];
+			n++;
+		}
+		if (hasLayout(elem, f, t, n))
+			return true;
+	}
+	return false;
+}
+
+// Face records of the form list <count> <index> vertex_indices [uchar red green blue]
+static bool isCommonFaceLayout(const PlyElement& elem, bool& colors) {
+	const auto& props = elem.properties;
+	if (props.empty() || props[0].field != PLY_FIELD_INDICES)
+		return false;
+	static const PlyField fields[3] = { PLY_FIELD_RED, PLY_FIELD_GREEN, PLY_FIELD_BLUE };
+	static const PlyType types[3] = { PLY_UCHAR, PLY_UCHAR, PLY_UCHAR };
+	colors = props.size() == 4;
+	for (size_t k = 1; k < props.size(); k++) {
+		if (k > 3 || props[k].field != fields[k - 1] || props[k].type != types[k - 1])
+			return false;
+	}
+	return true;
+}
+
+// Triangulates a polygon as a fan while its corners stream in
+class FanBuilder {
+public:
+	FanBuilder(std::vector<unsigned int>& elements) : out(elements), first(0), prev(0), n(0) {}
+	inline void add(unsigned int v) {
+		if (n >= 2) {
+			out.push_back(first);
+			out.push_back(prev);
+			out.push_back(v);
+		} else if (n == 0) {
+			first = v;
+		}
+		prev = v;
+		n++;
+	}
+	inline size_t corners() const { return n; }
+	inline void reset() { n = 0; }
+protected:
+	std::vector<unsigned int>& out;
+	unsigned int first, prev;
+	size_t n;
+};
+
+[[noreturn]] static void plyError(const std::string& filename, const char* what) {
+	std::stringstream ss;
+	ss << "Error reading " << filename << ": " << what;
+	throw std::runtime_error(ss.str());
+}
+
+// ---- ASCII decoders: one record per line ----
+
+// Fast path for the common vertex layout
+template<bool Normals, bool Colors>
+static const char* decodeVerticesASCII(const char* begin, const char* p, const char* end, const std::string& filename,
+	size_t count, PlyData& out) {
+	for (size_t i = 0; i < count; i++) {
+		PlyVertex vert;
+		vert.norm = glm::vec3(0.0f);
+		if (!parseFloat(p, end, vert.pos.x) || !parseFloat(p, end, vert.pos.y) || !parseFloat(p, end, vert.pos.z))
+			parseError(filename, begin, p, "malformed vertex");
+		if constexpr (Normals) {
+			if (!parseFloat(p, end, vert.norm.x) || !parseFloat(p, end, vert.norm.y) || !parseFloat(p, end, vert.norm.z))
+				parseError(filename, begin, p, "malformed vertex");
+		}
+		if constexpr (Colors) {
+			float r, g, b;
+			if (!parseFloat(p, end, r) || !parseFloat(p, end, g) || !parseFloat(p, end, b))
+				parseError(filename, begin, p, "malformed vertex");
+			out.vertexColors.push_back(glm::vec3(r / 255.0, g / 255.0, b / 255.0));
+		}
+		out.vertices.push_back(vert);
+		p = nextLine(p, end);
+	}
+	return p;
+}
+
+// Fast path for the common face layout
+template<bool Colors>
+static const char* decodeFacesASCII(const char* begin, const char* p, const char* end, const std::string& filename,
+	size_t count, PlyData& out) {
+	FanBuilder fan(out.v_elements);
+	for (size_t i = 0; i < count; i++) {
+		long n, v;
+		if (!parseInt(p, end, n) || n < 3)
+			parseError(filename, begin, p, "malformed face");
+		fan.reset();
+		for (long k = 0; k < n; k++) {
+			if (!parseInt(p, end, v) || v < 0)
+				parseError(filename, begin, p, "malformed face");
+			fan.add((unsigned int)v);
+		}
+		if constexpr (Colors) {
+			float r, g, b;
+			if (!parseFloat(p, end, r) || !parseFloat(p, end, g) || !parseFloat(p, end, b))
+				parseError(filename, begin, p, "malformed face");
+			out.colors.insert(out.colors.end(), n - 2, glm::vec3(r / 255.0, g / 255.0, b / 255.0));
+		}
+		p = nextLine(p, end);
+	}
+	return p;
+}
+
+// Any property order and type
+static const char* decodeElementASCII(const char* begin, const char* p, const char* end, const std::string& filename,
+	const PlyElement& elem, size_t count, PlyData& out) {
+	const bool vertexColors = elem.name == "vertex" && hasField(elem, PLY_FIELD_RED);
+	const bool faceColors = elem.name == "face" && hasField(elem, PLY_FIELD_RED);
+	FanBuilder fan(out.v_elements);
+	for (size_t i = 0; i < count; i++) {
+		PlyVertex vert;
+		vert.pos = vert.norm = glm::vec3(0.0f);
+		glm::vec3 color(0.0f);
+		fan.reset();
+		for (auto& prop : elem.properties) {
+			double value;
+			if (prop.countType != PLY_NONE) {
+				long n;
+				if (!parseInt(p, end, n) || n < 0)
+					parseError(filename, begin, p, "malformed list");
+				for (long k = 0; k < n; k++) {
+					if (!parseFloat(p, end, value))
+						parseError(filename, begin, p, "malformed list");
+					if (prop.field == PLY_FIELD_INDICES) {
+						if (value < 0.0)
+							parseError(filename, begin, p, "malformed face");
+						fan.add((unsigned int)value);
+					}
+				}
+				continue;
+			}
+			if (!parseFloat(p, end, value))
+				parseError(filename, begin, p, "malformed property");
+			switch (prop.field) {
+			case PLY_FIELD_X: vert.pos.x = (float)value; break;
+			case PLY_FIELD_Y: vert.pos.y = (float)value; break;
+			case PLY_FIELD_Z: vert.pos.z = (float)value; break;
+			case PLY_FIELD_NX: vert.norm.x = (float)value; break;
+			case PLY_FIELD_NY: vert.norm.y = (float)value; break;
+			case PLY_FIELD_NZ: vert.norm.z = (float)value; break;
+			case PLY_FIELD_RED: color.r = (float)(value / colorRange(prop.type)); break;
+			case PLY_FIELD_GREEN: color.g = (float)(value / colorRange(prop.type)); break;
+			case PLY_FIELD_BLUE: color.b = (float)(value / colorRange(prop.type)); break;
+			default: break;
+			}
+		}
+		if (elem.name == "vertex") {
+			out.vertices.push_back(vert);
+			if (vertexColors)
+				out.vertexColors.push_back(color);
+		} else if (elem.name == "face") {
+			if (fan.corners() < 3)
+				parseError(filename, begin, p, "face with fewer than 3 vertices");
+			if (faceColors)
+				out.colors.insert(out.colors.end(), fan.corners() - 2, color);
+		}
+		p = nextLine(p, end);
+	}
+	return p;
+}
+
+// ---- Binary decoders ----
+
+// Fast path for the common vertex layout, decoding into preallocated arrays.
+// The caller has checked that all records are in the buffer.
+template<bool Swap, bool Normals, bool Colors>
+static void decodeVerticesBinary(const char* p, size_t count, PlyVertex* dst, glm::vec3* colors) {
+	constexpr size_t stride = (Normals ? 6 : 3) * sizeof(float) + (Colors ? 3 : 0);
+
+	if constexpr (Normals && !Colors) {
+		// Same layout as PlyVertex: one memcpy, then a bulk byte swap if the endianness differs
+		static_assert(sizeof(PlyVertex) == stride, "PlyVertex must match a packed float x y z nx ny nz record");
+		memcpy(dst, p, count * stride);
+		if constexpr (Swap)
+			swapBytes32(dst, count * 6);
+	} else {
+		for (size_t i = 0; i < count; i++) {
+			const char* rec = p + i * stride;
+			dst[i].pos = glm::vec3(load<float, Swap>(rec), load<float, Swap>(rec + 4), load<float, Swap>(rec + 8));
+			if constexpr (Normals)
+				dst[i].norm = glm::vec3(load<float, Swap>(rec + 12), load<float, Swap>(rec + 16), load<float, Swap>(rec + 20));
+			else
+				dst[i].norm = glm::vec3(0.0f);
+			if constexpr (Colors) {
+				const uint8_t* rgb = (const uint8_t*)rec + stride - 3;
+				colors[i] = glm::vec3(rgb[0] / 255.0, rgb[1] / 255.0, rgb[2] / 255.0);
+			}
+		}
+	}
+}
+
+// Fast path for the common face layout
+template<typename CountT, typename IndexT, bool Swap, bool Colors>
+static const char* decodeFacesBinary(const char* p, const char* end, const std::string& filename,
+	size_t count, PlyData& out) {
+	FanBuilder fan(out.v_elements);
+	for (size_t i = 0; i < count; i++) {
+		if ((size_t)(end - p) < sizeof(CountT))
+			plyError(filename, "unexpected end of file");
+		size_t n = (size_t)load<CountT, Swap>(p);
+		p += sizeof(CountT);
+		if ((size_t)(end - p) < n * sizeof(IndexT) + (Colors ? 3 : 0))
+			plyError(filename, "unexpected end of file");
+		if (n < 3)
+			plyError(filename, "face with fewer than 3 vertices");
+		fan.reset();
+		for (size_t k = 0; k < n; k++)
+			fan.add((unsigned int)load<IndexT, Swap>(p + k * sizeof(IndexT)));
+		p += n * sizeof(IndexT);
+		if constexpr (Colors) {
+			const uint8_t* rgb = (const uint8_t*)p;
+			out.colors.insert(out.colors.end(), n - 2, glm::vec3(rgb[0] / 255.0, rgb[1] / 255.0, rgb[2] / 255.0));
+			p += 3;
+		}
+	}
+	return p;
+}
+
+// Instantiate the face fast path for the list types exporters actually write
+template<bool Swap>
+static bool dispatchFacesBinary(const PlyProperty& list, bool colors, const char*& p, const char* end,
+	const std::string& filename, size_t count, PlyData& out) {
+	#define PLY_FACES(CountT, IndexT) \
+		p = colors ? decodeFacesBinary<CountT, IndexT, Swap, true>(p, end, filename, count, out) \
+			: decodeFacesBinary<CountT, IndexT, Swap, false>(p, end, filename, count, out)
+	if (list.countType == PLY_UCHAR && list.type == PLY_INT) PLY_FACES(uint8_t, int32_t);
+	else if (list.countType == PLY_UCHAR && list.type == PLY_UINT) PLY_FACES(uint8_t, uint32_t);
+	else if (list.countType == PLY_INT && list.type == PLY_INT) PLY_FACES(int32_t, int32_t);
+	else if (list.countType == PLY_INT && list.type == PLY_UINT) PLY_FACES(int32_t, uint32_t);
+	else return false;
+	#undef PLY_FACES
+	return true;
+}
+
+// Any property order and type
+static const char* decodeElementBinary(const char* p, const char* end, const std::string& filename,
+	const PlyElement& elem, size_t count, bool swap, PlyData& out) {
+	const bool vertexColors = elem.name == "vertex" && hasField(elem, PLY_FIELD_RED);
+	const bool faceColors = elem.name == "face" && hasField(elem, PLY_FIELD_RED);
+	FanBuilder fan(out.v_elements);
+	for (size_t i = 0; i < count; i++) {
+		PlyVertex vert;
+		vert.pos = vert.norm = glm::vec3(0.0f);
+		glm::vec3 color(0.0f);
+		fan.reset();
+		for (auto& prop : elem.properties) {
+			const size_t size = plyTypeSize(prop.type);
+			if (prop.countType != PLY_NONE) {
+				// List: a count followed by that many values
+				const size_t countSize = plyTypeSize(prop.countType);
+				if ((size_t)(end - p) < countSize)
+					plyError(filename, "unexpected end of file");
+				double n = readBinary(p, prop.countType, swap);
+				p += countSize;
+				if (n < 0.0)
+					plyError(filename, "negative list count");
+				if ((size_t)(end - p) < (size_t)n * size)
+					plyError(filename, "unexpected end of file");
+				if (prop.field == PLY_FIELD_INDICES) {
+					for (size_t k = 0; k < (size_t)n; k++) {
+						double index = readBinary(p + k * size, prop.type, swap);
+						if (index < 0.0)
+							plyError(filename, "negative vertex index");
+						fan.add((unsigned int)index);
+					}
+				}
+				p += (size_t)n * size;
+				continue;
+			}
+			if ((size_t)(end - p) < size)
+				plyError(filename, "unexpected end of file");
+			if (prop.field != PLY_FIELD_NONE) {
+				double value = readBinary(p, prop.type, swap);
+				switch (prop.field) {
+				case PLY_FIELD_X: vert.pos.x = (float)value; break;
+				case PLY_FIELD_Y: vert.pos.y = (float)value; break;
+				case PLY_FIELD_Z: vert.pos.z = (float)value; break;
+				case PLY_FIELD_NX: vert.norm.x = (float)value; break;
+				case PLY_FIELD_NY: vert.norm.y = (float)value; break;
+				case PLY_FIELD_NZ: vert.norm.z = (float)value; break;
+				case PLY_FIELD_RED: color.r = (float)(value / colorRange(prop.type)); break;
+				case PLY_FIELD_GREEN: color.g = (float)(value / colorRange(prop.type)); break;
+				case PLY_FIELD_BLUE: color.b = (float)(value / colorRange(prop.type)); break;
+				default: break;
+				}
+			}
+			p += size;
+		}
+		if (elem.name == "vertex") {
+			out.vertices.push_back(vert);
+			if (vertexColors)
+				out.vertexColors.push_back(color);
+		} else if (elem.name == "face") {
+			if (fan.corners() < 3)
+				plyError(filename, "face with fewer than 3 vertices");
+			if (faceColors)
+				out.colors.insert(out.colors.end(), fan.corners() - 2, color);
+		}
+	}
+	return p;
+}
+
+// Skip the records of an element we do not use
+static const char* skipElement(const char* p, const char* end, const std::string& filename,
+	const PlyElement& elem, size_t count, PlyFormat format, bool swap) {
+	for (size_t i = 0; i < count; i++) {
+		if (format == PLY_ASCII) {
+			p = nextLine(p, end);
+			continue;
+		}
+		for (auto& prop : elem.properties) {
+			size_t n = 1;
+			if (prop.countType != PLY_NONE) {
+				if ((size_t)(end - p) < plyTypeSize(prop.countType))
+					plyError(filename, "unexpected end of file");
+				double count = readBinary(p, prop.countType, swap);
+				if (count < 0.0)
+					plyError(filename, "negative list count");
+				n = (size_t)count;
+				p += plyTypeSize(prop.countType);
+			}
+			if ((size_t)(end - p) < n * plyTypeSize(prop.type))
+				plyError(filename, "unexpected end of file");
+			p += n * plyTypeSize(prop.type);
+		}
+	}
+	return p;
+}
+
+// Vertex records of the common layout decoded by the binary fast path
+static size_t commonVertexStride(bool normals, bool colors) {
+	return (normals ? 6 : 3) * sizeof(float) + (colors ? 3 : 0);
+}
+
+// Decode the binary vertex fast path into out[first, first + count)
+static void decodeVerticesBinary(const char* p, size_t count, bool swap, bool normals, bool colors,
+	PlyData& out, size_t first) {
+	PlyVertex* dst = out.vertices.data() + first;
+	glm::vec3* dstColors = colors ? out.vertexColors.data() + first : nullptr;
+	#define PLY_VERTICES(S, N, C) decodeVerticesBinary<S, N, C>(p, count, dst, dstColors)
+	if (swap) {
+		if (normals) { if (colors) PLY_VERTICES(true, true, true); else PLY_VERTICES(true, true, false); }
+		else { if (colors) PLY_VERTICES(true, false, true); else PLY_VERTICES(true, false, false); }
+	} else {
+		if (normals) { if (colors) PLY_VERTICES(false, true, true); else PLY_VERTICES(false, true, false); }
+		else { if (colors) PLY_VERTICES(false, false, true); else PLY_VERTICES(false, false, false); }
+	}
+	#undef PLY_VERTICES
+}
+
+// Decode "count" records of an element starting at p, picking the fastest decoder for its schema.
+// Returns the position after the records.
+static const char* decodeRecords(const char* begin, const char* p, const char* end, const std::string& filename,
+	const PlyHeader& header, const PlyElement& elem, size_t count, bool swap, PlyData& out) {
+	bool normals, colors;
+	if (elem.name == "vertex") {
+		out.vertices.reserve(out.vertices.size() + count);
+		if (hasField(elem, PLY_FIELD_RED))
+			out.vertexColors.reserve(out.vertices.size() + count);
+
+		if (!isCommonVertexLayout(elem, normals, colors)) {
+			return (header.format == PLY_ASCII) ? decodeElementASCII(begin, p, end, filename, elem, count, out)
+				: decodeElementBinary(p, end, filename, elem, count, swap, out);
+		} else if (header.format == PLY_ASCII) {
+			#define PLY_VERTICES(N, C) decodeVerticesASCII<N, C>(begin, p, end, filename, count, out)
+			return normals ? (colors ? PLY_VERTICES(true, true) : PLY_VERTICES(true, false))
+				: (colors ? PLY_VERTICES(false, true) : PLY_VERTICES(false, false));
+			#undef PLY_VERTICES
+		} else {
+			const size_t stride = commonVertexStride(normals, colors);
+			if ((size_t)(end - p) / stride < count)
+				plyError(filename, "unexpected end of file");
+			size_t first = out.vertices.size();
+			out.vertices.resize(first + count);
+			if (colors)
+				out.vertexColors.resize(first + count);
+			decodeVerticesBinary(p, count, swap, normals, colors, out, first);
+			return p + count * stride;
+		}
+	} else if (elem.name == "face") {
+		out.v_elements.reserve(out.v_elements.size() + 3 * count);
+		if (hasField(elem, PLY_FIELD_RED))
+			out.colors.reserve(out.colors.size() + count);
+
+		bool fast = isCommonFaceLayout(elem, colors);
+		if (fast && header.format == PLY_ASCII)
+			return colors ? decodeFacesASCII<true>(begin, p, end, filename, count, out)
+				: decodeFacesASCII<false>(begin, p, end, filename, count, out);
+		else if (fast && swap)
+			fast = dispatchFacesBinary<true>(elem.properties[0], colors, p, end, filename, count, out);
+		else if (fast)
+			fast = dispatchFacesBinary<false>(elem.properties[0], colors, p, end, filename, count, out);
+		if (fast)
+			return p;
+		return (header.format == PLY_ASCII) ? decodeElementASCII(begin, p, end, filename, elem, count, out)
+			: decodeElementBinary(p, end, filename, elem, count, swap, out);
+	}
+	return skipElement(p, end, filename, elem, count, header.format, swap);
+}
+
+// Append the chunk results to "out" in chunk order
+static void mergeChunks(std::vector<PlyData>& chunks, PlyData& out) {
+	const size_t n = chunks.size();
+	std::vector<size_t> vertBase(n), colorBase(n), elemBase(n), faceBase(n);
+	size_t n_vert = out.vertices.size(), n_color = out.vertexColors.size();
+	size_t n_elem = out.v_elements.size(), n_face = out.colors.size();
+	for (size_t i = 0; i < n; i++) {
+		vertBase[i] = n_vert;
+		colorBase[i] = n_color;
+		elemBase[i] = n_elem;
+		faceBase[i] = n_face;
+		n_vert += chunks[i].vertices.size();
+		n_color += chunks[i].vertexColors.size();
+		n_elem += chunks[i].v_elements.size();
+		n_face += chunks[i].colors.size();
+	}
+	out.vertices.resize(n_vert);
+	out.vertexColors.resize(n_color);
+	out.v_elements.resize(n_elem);
+	out.colors.resize(n_face);
+	ThreadPool::instance().parallelFor(n, [&](size_t i) {
+		PlyData& c = chunks[i];
+		std::copy(c.vertices.begin(), c.vertices.end(), out.vertices.begin() + vertBase[i]);
+		std::copy(c.vertexColors.begin(), c.vertexColors.end(), out.vertexColors.begin() + colorBase[i]);
+		std::copy(c.v_elements.begin(), c.v_elements.end(), out.v_elements.begin() + elemBase[i]);
+		std::copy(c.colors.begin(), c.colors.end(), out.colors.begin() + faceBase[i]);
+	});
+}
+
+void parsePLY(const char* begin, const char* end, const std::string& filename, PlyData& out) {
+	PlyHeader header = parsePLYHeader(begin, end, filename);
+	const bool swap = header.format != PLY_ASCII && (header.format == PLY_BINARY_LE) != hostIsLittleEndian();
+
+	for (auto& elem : header.elements) {
+		if (elem.name == "vertex") {
+			if (!hasField(elem, PLY_FIELD_X) || !hasField(elem, PLY_FIELD_Y) || !hasField(elem, PLY_FIELD_Z))
+				plyError(filename, "vertex element without x, y, z");
+			out.hasNormals = hasField(elem, PLY_FIELD_NX) && hasField(elem, PLY_FIELD_NY) && hasField(elem, PLY_FIELD_NZ);
+		} else if (elem.name == "face" && !hasField(elem, PLY_FIELD_INDICES)) {
+			plyError(filename, "face element without a vertex_indices list");
+		}
+	}
+
+	ThreadPool& pool = ThreadPool::instance();
+	const char* body = begin + header.size;
+	if (header.format == PLY_ASCII) {
+		// One record per line: split the body at line starts and find out which records each chunk holds
+		std::vector<const char*> bounds = splitAtLines(body, end, 1 << 20, 4 * pool.concurrency());
+		const size_t n = bounds.size() - 1;
+		std::vector<size_t> firstRecord(n + 1, 0);
+		pool.parallelFor(n, [&](size_t i) {
+			firstRecord[i + 1] = std::count(bounds[i], bounds[i + 1], '\n');
+		});
+		if (bounds[n] > bounds[n - 1] && bounds[n][-1] != '\n')
+			firstRecord[n]++;  // last line without a newline
+		for (size_t i = 0; i < n; i++)
+			firstRecord[i + 1] += firstRecord[i];
+
+		// Each chunk decodes the parts of the elements that fall inside it
+		std::vector<PlyData> chunks(n);
+		pool.parallelFor(n, [&](size_t i) {
+			const char* p = bounds[i];
+			size_t elemStart = 0;
+			for (auto& elem : header.elements) {
+				size_t from = std::max(firstRecord[i], elemStart);
+				size_t to = std::min(firstRecord[i + 1], elemStart + elem.count);
+				if (from < to)
+					p = decodeRecords(begin, p, end, filename, header, elem, to - from, swap, chunks[i]);
+				elemStart += elem.count;
+			}
+		});
+		mergeChunks(chunks, out);
+		return;
+	}
+
+	// Binary: records with lists can only be found by walking them, so only the fixed-size
+	// vertex fast path is split across cores
+	const char* p = body;
+	for (auto& elem : header.elements) {
+		bool normals, colors;
+		if (elem.name == "vertex" && isCommonVertexLayout(elem, normals, colors)) {
+			const size_t stride = commonVertexStride(normals, colors);
+			if ((size_t)(end - p) / stride < elem.count)
+				plyError(filename, "unexpected end of file");
+			size_t first = out.vertices.size();
+			out.vertices.resize(first + elem.count);
+			if (colors)
+				out.vertexColors.resize(first + elem.count);
+			const size_t block = 1 << 16;
+			pool.parallelFor((elem.count + block - 1) / block, [&](size_t i) {
+				size_t count = std::min(block, elem.count - i * block);
+				decodeVerticesBinary(p + i * block * stride, count, swap, normals, colors, out, first + i * block);
+			});
+			p += elem.count * stride;
+		} else {
+			p = decodeRecords(begin, p, end, filename, header, elem, elem.count, swap, out);
+		}
+	}
+}
@@ -0,0 +1,76 @@
+#ifndef PLYPARSER_HPP
+#define PLYPARSER_HPP
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Encoding of the PLY body
+enum PlyFormat {
+	PLY_ASCII,
+	PLY_BINARY_LE,	// binary_little_endian
+	PLY_BINARY_BE	// binary_big_endian
+};
+
+// Scalar type of a PLY property
+enum PlyType {
+	PLY_NONE,
+	PLY_CHAR, PLY_UCHAR,
+	PLY_SHORT, PLY_USHORT,
+	PLY_INT, PLY_UINT,
+	PLY_FLOAT, PLY_DOUBLE
+};
+
+// What a property is used for, resolved from the element and property names
+enum PlyField {
+	PLY_FIELD_NONE,		// Not used by the mesh (skipped)
+	PLY_FIELD_X, PLY_FIELD_Y, PLY_FIELD_Z,
+	PLY_FIELD_NX, PLY_FIELD_NY, PLY_FIELD_NZ,
+	PLY_FIELD_RED, PLY_FIELD_GREEN, PLY_FIELD_BLUE,
+	PLY_FIELD_INDICES	// Vertex index list of a face
+};
+
+// One "property" line of the header
+struct PlyProperty {
+	std::string name;
+	PlyType type;		// Value type (type of the entries for a list)
+	PlyType countType;	// Type of the list length, PLY_NONE if this is not a list
+	PlyField field;		// Role of the property
+};
+
+// One "element" block of the header
+struct PlyElement {
+	std::string name;
+	size_t count;
+	std::vector<PlyProperty> properties;
+};
+
+// The header doubles as the property schema the body decoders are selected from
+struct PlyHeader {
+	PlyFormat format;
+	std::vector<PlyElement> elements;
+	size_t size;		// Header length in bytes; the body starts right after it
+};
+
+// Vertex record; binary files with exactly this layout are copied in with a single memcpy
+struct PlyVertex {
+	glm::vec3 pos;		// Position
+	glm::vec3 norm;		// Normal
+};
+
+// Raw contents of a PLY file; polygons are triangulated as fans
+struct PlyData {
+	std::vector<PlyVertex> vertices;		// Vertex records (normals are zero if the file has none)
+	std::vector<glm::vec3> vertexColors;	// Color of each vertex, empty if the vertices have no color
+	std::vector<unsigned int> v_elements;	// Vertex index of each triangle corner
+	std::vector<glm::vec3> colors;			// Color of each triangle, empty if the faces have no color
+	bool hasNormals = false;				// Whether the vertices have nx, ny, nz
+};
+
+// Parse the header at the start of [begin, end) and resolve the role of each property
+PlyHeader parsePLYHeader(const char* begin, const char* end, const std::string& filename);
+// Parse a whole PLY file in [begin, end); the output arrays are sized from the header counts.
+// ASCII bodies are split into chunks of whole lines that are decoded on all cores.
+void parsePLY(const char* begin, const char* end, const std::string& filename, PlyData& out);
+
+#endif
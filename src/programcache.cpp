@@ -0,0 +1,164 @@
+#define NOMINMAX
+#include "programcache.hpp"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include "mapfile.hpp"
+#include "meshcache.hpp"
+#include "util.hpp"
+namespace fs = std::filesystem;
+
+// ARB_get_program_binary is not part of the 3.3 loader
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+typedef void (GL_APIENTRY *PFN_glGetProgramBinary)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (GL_APIENTRY *PFN_glProgramBinary)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (GL_APIENTRY *PFN_glProgramParameteri)(GLuint program, GLenum pname, GLint value);
+
+// Start of every cached binary; the driver's blob follows
+struct ProgramCacheHeader {
+	char magic[8];			// "PROGBLOB"
+	uint32_t version;		// programCacheVersion
+	uint32_t format;		// Driver's binary format
+	uint64_t key;			// programCacheKey() of the program
+	uint64_t length;		// Bytes of binary after the header
+	uint64_t binaryHash;	// hashBytes() of the binary
+};
+
+static const char cacheMagic[8] = { 'P', 'R', 'O', 'G', 'B', 'L', 'O', 'B' };
+
+// Entry points, resolved on first use
+static struct {
+	bool checked = false;
+	bool supported = false;
+	PFN_glGetProgramBinary getProgramBinary = nullptr;
+	PFN_glProgramBinary programBinary = nullptr;
+	PFN_glProgramParameteri programParameteri = nullptr;
+} api;
+
+bool programBinarySupported() {
+	if (api.checked)
+		return api.supported;
+	api.checked = true;
+	if (!hasExtension("GL_ARB_get_program_binary"))
+		return false;
+	api.getProgramBinary = (PFN_glGetProgramBinary)getProcAddress("glGetProgramBinary");
+	api.programBinary = (PFN_glProgramBinary)getProcAddress("glProgramBinary");
+	api.programParameteri = (PFN_glProgramParameteri)getProcAddress("glProgramParameteri");
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	api.supported = api.getProgramBinary && api.programBinary && api.programParameteri && formats > 0;
+	return api.supported;
+}
+
+uint64_t programCacheKey(const std::vector<std::string>& sources, const std::string& defines) {
+	std::string text;
+	for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION }) {
+		const char* s = (const char*)glGetString(name);
+		text += s ? s : "";
+		text += '\n';
+	}
+	text += defines;
+	uint64_t key = hashBytes(text.data(), text.size());
+	for (const std::string& s : sources)
+		key = (key ^ hashBytes(s.data(), s.size())) * 0x9E3779B97F4A7C15ull;
+	return key;
+}
+
+std::string programCachePath(const std::string& dir, uint64_t key) {
+	std::stringstream name;
+	name << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+	return (fs::path(dir) / ".programcache" / name.str()).string();
+}
+
+void setProgramRetrievable(GLuint program) {
+	if (programBinarySupported())
+		api.programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+GLuint readProgramCache(const std::string& dir, uint64_t key) {
+	if (!programBinarySupported())
+		return 0;
+	try {
+		std::string path = programCachePath(dir, key);
+		std::error_code ec;
+		if (!fs::is_regular_file(path, ec))
+			return 0;
+
+		MappedFile blob(path);
+		ProgramCacheHeader h;
+		if (blob.size() < sizeof(h))
+			return 0;
+		memcpy(&h, blob.data(), sizeof(h));
+		if (memcmp(h.magic, cacheMagic, sizeof(cacheMagic)) != 0 || h.version != programCacheVersion ||
+			h.key != key || h.length != blob.size() - sizeof(h) || h.length > 0x7fffffff ||
+			hashBytes(blob.data() + sizeof(h), h.length) != h.binaryHash)
+			return 0;
+
+		// The driver has the last word on whether the binary still suits it
+		GLuint program = glCreateProgram();
+		api.programBinary(program, h.format, blob.data() + sizeof(h), (GLsizei)h.length);
+		GLint status = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &status);
+		if (status == GL_FALSE) {
+			glDeleteProgram(program);
+			return 0;
+		}
+		return program;
+	} catch (const std::exception&) {
+		return 0;  // unreadable blob: compile from source
+	}
+}
+
+bool writeProgramCache(const std::string& dir, uint64_t key, GLuint program) {
+	if (!programBinarySupported())
+		return false;
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return false;
+	std::vector<unsigned char> binary(length);
+	GLenum format = 0;
+	GLsizei written = 0;
+	api.getProgramBinary(program, length, &written, &format, binary.data());
+	if (written <= 0)
+		return false;
+
+	std::string path = programCachePath(dir, key);
+	std::string tmp = path + ".tmp";
+	try {
+		ProgramCacheHeader h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, cacheMagic, sizeof(cacheMagic));
+		h.version = programCacheVersion;
+		h.format = format;
+		h.key = key;
+		h.length = (uint64_t)written;
+		h.binaryHash = hashBytes(binary.data(), written);
+
+		// Write to a temporary file and rename it, so a reader never sees a partial blob
+		fs::create_directories(fs::path(path).parent_path());
+		{
+			std::ofstream ostr(tmp, std::ios::binary | std::ios::trunc);
+			ostr.write((const char*)&h, sizeof(h));
+			ostr.write((const char*)binary.data(), written);
+			if (!ostr)
+				throw std::runtime_error("write failed");
+		}
+		fs::rename(tmp, path);
+		return true;
+	} catch (const std::exception&) {
+		std::error_code ec;
+		fs::remove(tmp, ec);
+		return false;  // e.g. read-only shaders directory; programs are just compiled every time
+	}
+}
@@ -0,0 +1,29 @@
+#ifndef PROGRAMCACHE_HPP
+#define PROGRAMCACHE_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "gl_core_3_3.h"
+
+// Bump whenever the cache layout changes
+const uint32_t programCacheVersion = 1;
+
+// Whether the driver hands out linked program binaries (ARB_get_program_binary, core in GL
+// 4.1) in at least one format. Checked once, on the GL thread.
+bool programBinarySupported();
+// Key of a program: a hash of the source of each stage in link order, the defines prepended to
+// them, and the driver's vendor, renderer, and version strings
+uint64_t programCacheKey(const std::vector<std::string>& sources, const std::string& defines);
+// Path of the cached binary of a program: <dir>/.programcache/<key>.bin
+std::string programCachePath(const std::string& dir, uint64_t key);
+
+// Ask the driver to keep the binary of a program it is about to link
+void setProgramRetrievable(GLuint program);
+// Create a program from its cached binary. Returns 0 if there is none, or it is corrupt, or
+// the driver rejects it (e.g. after an update it forgot to report in the version string).
+GLuint readProgramCache(const std::string& dir, uint64_t key);
+// Store the binary of a linked program made retrievable; returns false if it could not be written
+bool writeProgramCache(const std::string& dir, uint64_t key, GLuint program);
+
+#endif
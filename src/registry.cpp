@@ -0,0 +1,144 @@
+#define NOMINMAX
+#include "registry.hpp"
+#include <iostream>
+#include <filesystem>
+#include "mapfile.hpp"
+#include "meshcache.hpp"
+#include "threadpool.hpp"
+namespace fs = std::filesystem;
+
+std::vector<GeometryRegistry::Handle> GeometryRegistry::load(const std::vector<std::string>& filenames,
+	Mesh::VertexFormat format, GeometryArena* arena, const std::vector<uint8_t>& uses) {
+	std::vector<Handle> handles(filenames.size(), invalidHandle);
+
+	// Files whose path has not been seen yet, each listed once
+	std::vector<std::string> keys(filenames.size());
+	std::vector<size_t> newFiles;
+	std::vector<uint8_t> fileUses;  // combined uses of each new file
+	std::unordered_map<std::string, size_t> pending;
+	for (size_t i = 0; i < filenames.size(); i++) {
+		keys[i] = pathKey(filenames[i]);
+		if (byPath.count(keys[i]))
+			continue;
+		uint8_t use = uses.empty() ? (uint8_t)USE_DRAW : uses[i];
+		auto found = pending.emplace(keys[i], newFiles.size());
+		if (found.second) {
+			newFiles.push_back(i);
+			fileUses.push_back(use);
+		} else
+			fileUses[found.first->second] |= use;
+	}
+
+	// Hash the new files so copies of a model under another name are shared too
+	std::vector<uint64_t> hashes(newFiles.size());
+	std::vector<std::string> errors(newFiles.size());
+	ThreadPool::instance().parallelFor(newFiles.size(), [&](size_t j) {
+		try {
+			MappedFile file(filenames[newFiles[j]]);
+			hashes[j] = hashBytes(file.data(), file.size());
+		} catch (const std::exception& e) {
+			errors[j] = e.what();
+		}
+	});
+	std::vector<size_t> toRead;  // indices into newFiles of the distinct contents to read
+	std::vector<uint8_t> readUses;  // combined uses of each distinct content
+	std::unordered_map<uint64_t, size_t> pendingContent;
+	for (size_t j = 0; j < newFiles.size(); j++) {
+		if (!errors[j].empty() || byContent.count(hashes[j]))
+			continue;
+		auto found = pendingContent.emplace(hashes[j], toRead.size());
+		if (found.second) {
+			toRead.push_back(j);
+			readUses.push_back(fileUses[j]);
+		} else
+			readUses[found.first->second] |= fileUses[j];
+	}
+
+	// Read, parse, and build the vertices of the distinct models on the worker pool
+	std::vector<Mesh::Geometry> geoms(toRead.size());
+	ThreadPool::instance().parallelFor(toRead.size(), [&](size_t k) {
+		size_t j = toRead[k];
+		try {
+			geoms[k] = Mesh::readFile(filenames[newFiles[j]]);
+		} catch (const std::exception& e) {
+			errors[j] = e.what();
+		}
+	});
+
+	// Only the buffer uploads happen here, on the GL thread, and only for models drawn as such
+	for (size_t k = 0; k < toRead.size(); k++) {
+		size_t j = toRead[k];
+		if (!errors[j].empty())
+			continue;
+		byContent[hashes[j]] = (Handle)meshes.size();
+		meshes.push_back(readUses[k] & USE_DRAW ?
+			std::unique_ptr<Mesh>(new Mesh(geoms[k], false, format, arena)) : nullptr);
+		if (readUses[k] & USE_SOURCE)
+			sources.push_back(std::move(geoms[k]));
+		else {
+			sources.push_back(Mesh::Geometry());
+			geoms[k] = Mesh::Geometry();  // free the CPU copy early
+		}
+	}
+	for (size_t j = 0; j < newFiles.size(); j++) {
+		if (!errors[j].empty()) {
+			std::cerr << errors[j] << std::endl;  // skip models that failed to load
+			continue;
+		}
+		auto found = byContent.find(hashes[j]);
+		if (found != byContent.end())
+			byPath[keys[newFiles[j]]] = found->second;
+	}
+
+	for (size_t i = 0; i < filenames.size(); i++) {
+		auto found = byPath.find(keys[i]);
+		if (found != byPath.end())
+			handles[i] = found->second;
+	}
+	return handles;
+}
+
+GeometryRegistry::Handle GeometryRegistry::add(Mesh::Geometry& geom, Mesh::VertexFormat format, GeometryArena* arena) {
+	meshes.push_back(std::unique_ptr<Mesh>(new Mesh(geom, false, format, arena)));
+	sources.push_back(Mesh::Geometry());
+	return (Handle)(meshes.size() - 1);
+}
+
+GeometryRegistry::Handle GeometryRegistry::add(Mesh::Staged& staged, GeometryArena* arena,
+	const std::string& filename, uint64_t contentHash) {
+	Handle h = (Handle)meshes.size();
+	meshes.push_back(std::unique_ptr<Mesh>(new Mesh(staged, arena)));
+	sources.push_back(Mesh::Geometry());
+	if (!filename.empty()) {
+		byPath[pathKey(filename)] = h;
+		byContent.emplace(contentHash, h);
+	}
+	return h;
+}
+
+void GeometryRegistry::dropSources() {
+	sources = std::vector<Mesh::Geometry>(meshes.size());
+	for (auto it = byPath.begin(); it != byPath.end();) {
+		if (!meshes[it->second])
+			it = byPath.erase(it);
+		else
+			++it;
+	}
+	for (auto it = byContent.begin(); it != byContent.end();) {
+		if (!meshes[it->second])
+			it = byContent.erase(it);
+		else
+			++it;
+	}
+}
+
+GeometryRegistry::Handle GeometryRegistry::findContent(uint64_t contentHash) const {
+	auto found = byContent.find(contentHash);
+	return found != byContent.end() ? found->second : invalidHandle;
+}
+
+std::string GeometryRegistry::pathKey(const std::string& filename) {
+	std::error_code ec;
+	std::string key = fs::weakly_canonical(filename, ec).string();
+	return ec ? filename : key;
+}
@@ -0,0 +1,69 @@
+#ifndef REGISTRY_HPP
+#define REGISTRY_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+#include "mesh.hpp"
+
+// Owns the GPU geometry of every model file in use. Each model is loaded and uploaded once
+// no matter how many scene objects place it; objects refer to it by handle.
+class GeometryRegistry {
+public:
+	typedef uint32_t Handle;
+	static const Handle invalidHandle = ~Handle(0);
+	// What the objects placing a model file need of it (bit flags)
+	enum Use : uint8_t {
+		USE_DRAW = 1,		// drawn as its own object: upload it
+		USE_SOURCE = 2,		// merged into a static batch: keep its CPU-side geometry
+	};
+
+	GeometryRegistry() {}
+	// Disallow copy, move, & assignment
+	GeometryRegistry(const GeometryRegistry& other) = delete;
+	GeometryRegistry& operator=(const GeometryRegistry& other) = delete;
+	GeometryRegistry(GeometryRegistry&& other) = delete;
+	GeometryRegistry& operator=(GeometryRegistry&& other) = delete;
+
+	// Return the handle of each file, loading the ones not seen before. Files are matched by
+	// path and then by content hash; new ones are read on the thread pool and uploaded on the
+	// calling (GL) thread with the given vertex format, into the arena if one is given. Files
+	// that fail to load are reported and get invalidHandle.
+	// uses gives the Use flags of each file (all USE_DRAW if empty). A new model is only
+	// uploaded if some file placing it has USE_DRAW, and its CPU-side geometry is only kept
+	// (see source()) if one has USE_SOURCE.
+	std::vector<Handle> load(const std::vector<std::string>& filenames,
+		Mesh::VertexFormat format = Mesh::VERTEX_FLOAT, GeometryArena* arena = nullptr,
+		const std::vector<uint8_t>& uses = std::vector<uint8_t>());
+	// Upload geometry built at run time (e.g. a static batch) under a new handle
+	Handle add(Mesh::Geometry& geom, Mesh::VertexFormat format = Mesh::VERTEX_FLOAT, GeometryArena* arena = nullptr);
+	// Take over geometry staged on another thread (see AssetLoader) under a new handle. Given
+	// the model file and the hash of its contents, later lookups find it like a loaded file.
+	Handle add(Mesh::Staged& staged, GeometryArena* arena = nullptr,
+		const std::string& filename = std::string(), uint64_t contentHash = 0);
+	// Handle of a model file with the given content hash, or invalidHandle
+	Handle findContent(uint64_t contentHash) const;
+	// Key files are matched by: the canonical path, or the name as given if there is none
+	static std::string pathKey(const std::string& filename);
+
+	// access (get() only for handles that were uploaded):
+	inline Mesh& get(Handle h) { return *meshes[h]; }
+	inline const Mesh& get(Handle h) const { return *meshes[h]; }
+	inline size_t size() const { return meshes.size(); }
+	inline bool uploaded(Handle h) const { return meshes[h] != nullptr; }
+	// CPU-side geometry of a model loaded with USE_SOURCE (empty otherwise)
+	inline const Mesh::Geometry& source(Handle h) const { return sources[h]; }
+	// Free the kept geometry. Models that were never uploaded are forgotten, so a later
+	// load() reads them again.
+	void dropSources();
+
+protected:
+	std::vector<std::unique_ptr<Mesh>> meshes;			// Geometry of each handle, if uploaded
+	std::vector<Mesh::Geometry> sources;				// CPU copy of each handle's geometry, if kept
+	std::unordered_map<std::string, Handle> byPath;		// Canonical path -> handle
+	std::unordered_map<uint64_t, Handle> byContent;		// Source file hash -> handle
+};
+
+#endif
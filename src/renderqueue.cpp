@@ -0,0 +1,60 @@
+#define NOMINMAX
+#include "renderqueue.hpp"
+#include <algorithm>
+#include <cstring>
+
+// Below this many packets a comparison sort beats the eight histogram passes
+static const size_t radixThreshold = 256;
+
+void RenderQueue::resize(size_t objectCount) {
+	objectKeys.assign(objectCount, 0);
+	packets.clear();
+	packets.reserve(objectCount);
+	scratch.reserve(objectCount);
+}
+
+void RenderQueue::sort() {
+	auto byKey = [](const Packet& a, const Packet& b) { return a.key < b.key; };
+	if (std::is_sorted(packets.begin(), packets.end(), byKey)) {
+		skipCount++;
+		return;
+	}
+	sortCount++;
+	if (packets.size() < radixThreshold)
+		std::sort(packets.begin(), packets.end(), byKey);
+	else
+		radixSort();
+}
+
+// Least significant digit first, one byte at a time. All eight histograms are gathered in one
+// pass, and bytes that are the same in every key (e.g. the program) are skipped.
+void RenderQueue::radixSort() {
+	const size_t n = packets.size();
+	scratch.resize(n);  // within the reserved capacity
+	size_t counts[8][256];
+	memset(counts, 0, sizeof(counts));
+	for (const Packet& p : packets) {
+		for (int digit = 0; digit < 8; digit++)
+			counts[digit][(p.key >> (8 * digit)) & 0xff]++;
+	}
+
+	Packet* src = packets.data();
+	Packet* dst = scratch.data();
+	for (int digit = 0; digit < 8; digit++) {
+		size_t* count = counts[digit];
+		const int shift = 8 * digit;
+		if (count[(src[0].key >> shift) & 0xff] == n)
+			continue;
+		size_t offset = 0;
+		for (int b = 0; b < 256; b++) {
+			size_t c = count[b];
+			count[b] = offset;
+			offset += c;
+		}
+		for (size_t i = 0; i < n; i++)
+			dst[count[(src[i].key >> shift) & 0xff]++] = src[i];
+		std::swap(src, dst);
+	}
+	if (src != packets.data())
+		memcpy(packets.data(), src, n * sizeof(Packet));
+}
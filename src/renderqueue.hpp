@@ -0,0 +1,69 @@
+#ifndef RENDERQUEUE_HPP
+#define RENDERQUEUE_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Draw packets of the visible objects, sorted by a 64-bit key so that state changes are
+// grouped. The part of each key that only depends on the object (program and geometry) is
+// retained between frames; every frame adds the level of detail and a depth bucket. Storage is
+// reserved when the scene changes, so filling and sorting the queue never allocates.
+class RenderQueue {
+public:
+	// Key layout, most significant first: program | geometry | level of detail | depth
+	static const int programShift = 56;		// 8 bits
+	static const int geometryShift = 32;	// 24 bits
+	static const int lodShift = 24;			// 8 bits
+	static const int depthBits = 16;		// Front to back, below the bits that select state
+	// Packets whose keys agree above this shift can be drawn with one instanced call
+	static const int stateShift = lodShift;
+
+	struct Packet {
+		uint64_t key;
+		uint32_t object;	// Index into the scene's objects
+	};
+
+	RenderQueue() : sortCount(0), skipCount(0) {}
+	// Disallow copy, move, & assignment
+	RenderQueue(const RenderQueue& other) = delete;
+	RenderQueue& operator=(const RenderQueue& other) = delete;
+	RenderQueue(RenderQueue&& other) = delete;
+	RenderQueue& operator=(RenderQueue&& other) = delete;
+
+	// Size the queue for a scene of objectCount objects; their keys start out as 0
+	void resize(size_t objectCount);
+	// Set the retained part of an object's key (only when its program or geometry changes)
+	inline void setObjectKey(uint32_t object, uint32_t program, uint32_t geometry) {
+		objectKeys[object] = ((uint64_t)(program & 0xff) << programShift) | ((uint64_t)(geometry & 0xffffff) << geometryShift);
+	}
+
+	// Start a frame
+	inline void clear() { packets.clear(); }
+	// Queue a visible object. depth is a view-space distance normalized to [0, 1].
+	inline void push(uint32_t object, size_t lod, float depth) {
+		float d = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+		uint64_t bucket = (uint64_t)(d * ((1 << depthBits) - 1));
+		packets.push_back(Packet{ objectKeys[object] | ((uint64_t)(lod & 0xff) << lodShift) | bucket, object });
+	}
+	// Order the packets by key. Nothing is done if they are in order already, as they usually are
+	// when the view changes little between frames.
+	void sort();
+
+	// access:
+	inline const std::vector<Packet>& getPackets() const { return packets; }
+	inline size_t capacity() const { return objectKeys.size(); }
+	// Number of sort() calls that sorted, and that found the packets in order
+	inline size_t getSortCount() const { return sortCount; }
+	inline size_t getSkipCount() const { return skipCount; }
+
+protected:
+	void radixSort();
+
+	std::vector<uint64_t> objectKeys;	// Retained key bits of each object
+	std::vector<Packet> packets;		// This frame's packets
+	std::vector<Packet> scratch;		// Radix sort buffer
+	size_t sortCount, skipCount;
+};
+
+#endif
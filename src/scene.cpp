@@ -2,21 +2,40 @@
 #include <iostream>
 #include <filesystem>
 #include <fstream>
+#include <unordered_map>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include "scene.hpp"
+#include "frustum.hpp"
+#include "batch.hpp"
 using namespace std;
 namespace fs = std::filesystem;
 
-void Scene::parseScene() {
+// Loader requests of each scene get a tag of their own
+static uint32_t nextSerial = 1;
+static const uint32_t noRequest = ~uint32_t(0);
+
+Scene::Scene() :
+	nObj(0),
+	batchedCount(0),
+	batchCount(0),
+	serial(nextSerial++),
+	outstanding(0),
+	batchRequest(noRequest) {}
+
+void Scene::readSceneFile(vector<string>& filenames, vector<glm::mat4>& modelMats, vector<bool>& isStatic) {
 	string modelsDir = fs::current_path().string() + "/models/";  // current directory
 	string sceneFile = modelsDir + "scene_a1.txt";  // scene file
 	ifstream istr(sceneFile);
+
 	try {  // read the file
 		istr >> nObj;
 		for (int i = 0; i < nObj; i++) {  // for each object
 			string objFilename;
 			istr >> objFilename;
+			bool staticObj = objFilename == "static";
+			if (staticObj)
+				istr >> objFilename;
 			glm::mat3 rotMat;  // rotation matrix
 			glm::vec3 translation;  // translation vector
 			for (int j = 0; j < 3; j++) {
@@ -26,11 +45,12 @@ void Scene::parseScene() {
 			}
 			for (int j = 0; j < 3; j++)
 				istr >> translation[j];
+			if (!istr)
+				break;  // truncated scene file
 
-			glm::mat4 modelMat = calModelMat(rotMat, translation);  // model matrix
-			auto mesh = std::make_shared<Mesh>(modelsDir + objFilename);  // construct the mesh
-			mesh->setModelMat(modelMat);
-			objects.push_back(mesh);  // store the mesh
+			filenames.push_back(modelsDir + objFilename);
+			modelMats.push_back(calModelMat(rotMat, translation));  // model matrix
+			isStatic.push_back(staticObj);
 		}
 	}
 	catch (const std::exception& e) {
@@ -38,6 +58,133 @@ void Scene::parseScene() {
 	}
 }
 
+void Scene::parseScene(Mesh::VertexFormat format, GeometryArena* arena, bool batchStatic) {
+	// Read the object list first so the models can be loaded together
+	vector<string> filenames;
+	vector<glm::mat4> modelMats;
+	vector<bool> isStatic;
+	readSceneFile(filenames, modelMats, isStatic);
+
+	// Each distinct model is loaded once, however many objects place it. It is uploaded only
+	// if some object draws it directly, and kept on the CPU only if some object is batched.
+	vector<uint8_t> uses(filenames.size(), GeometryRegistry::USE_DRAW);
+	for (size_t i = 0; i < filenames.size(); i++) {
+		if (batchStatic && isStatic[i])
+			uses[i] = GeometryRegistry::USE_SOURCE;
+	}
+	vector<GeometryRegistry::Handle> handles = geometry.load(filenames, format, arena, uses);
+	vector<StaticInstance> statics;
+	for (size_t i = 0; i < filenames.size(); i++) {
+		if (handles[i] == GeometryRegistry::invalidHandle)
+			continue;  // failed to load (already reported)
+		if (batchStatic && isStatic[i]) {
+			statics.push_back(StaticInstance{ &geometry.source(handles[i]), modelMats[i] });
+			continue;
+		}
+		addObject(handles[i], modelMats[i]);
+	}
+
+	// Merge the static objects into world-space batches, which are drawn like any other object
+	vector<Mesh::Geometry> batches = buildStaticBatches(statics);
+	batchedCount = statics.size();
+	batchCount = batches.size();
+	geometry.dropSources();
+	for (Mesh::Geometry& batch : batches)
+		addObject(geometry.add(batch, format, arena), glm::mat4(1.0f));
+
+	buildBvh();
+}
+
+void Scene::beginLoad(AssetLoader& loader, Mesh::VertexFormat format, bool batchStatic) {
+	vector<string> filenames;
+	vector<glm::mat4> modelMats;
+	vector<bool> isStatic;
+	readSceneFile(filenames, modelMats, isStatic);
+
+	// One request per distinct model file, and one for all the static placements together.
+	// Copies of a model under other names are merged as they arrive (see update()).
+	std::unordered_map<string, uint32_t> requestOf;
+	AssetLoader::Request statics{ serial, 0, {}, {}, format };
+	for (size_t i = 0; i < filenames.size(); i++) {
+		if (batchStatic && isStatic[i]) {
+			statics.filenames.push_back(filenames[i]);
+			statics.modelMats.push_back(modelMats[i]);
+			continue;
+		}
+		const string key = GeometryRegistry::pathKey(filenames[i]);
+		auto found = requestOf.find(key);
+		if (found == requestOf.end()) {
+			found = requestOf.emplace(key, (uint32_t)placements.size()).first;
+			requestFiles.push_back(filenames[i]);
+			placements.push_back(vector<glm::mat4>());
+			loader.request(AssetLoader::Request{ serial, found->second, { filenames[i] }, {}, format });
+			outstanding++;
+		}
+		placements[found->second].push_back(modelMats[i]);
+	}
+	if (!statics.filenames.empty()) {
+		batchRequest = statics.id = (uint32_t)placements.size();
+		batchedCount = statics.filenames.size();
+		placements.push_back(vector<glm::mat4>());
+		requestFiles.push_back(string());
+		loader.request(std::move(statics));
+		outstanding++;
+	}
+}
+
+bool Scene::update(AssetLoader& loader, GeometryArena* arena, size_t maxResults) {
+	bool added = false;
+	AssetLoader::Result r;
+	for (size_t n = 0; n < maxResults && loader.poll(r); n++) {
+		if (r.owner != serial) {
+			r.staged.release();  // requested by a scene that was replaced
+			continue;
+		}
+		if (r.last)
+			outstanding--;
+		if (!r.error.empty())
+			std::cerr << r.error << std::endl;  // skip models that failed to load
+		if (r.empty)
+			continue;
+		if (r.id == batchRequest) {
+			GeometryRegistry::Handle h = geometry.add(r.staged, arena);
+			addObject(h, glm::mat4(1.0f));  // batches are already in world space
+			batchCount++;
+		} else {
+			// A model already taken in under another name is drawn from that copy
+			GeometryRegistry::Handle h = geometry.findContent(r.contentHash);
+			if (h == GeometryRegistry::invalidHandle)
+				h = geometry.add(r.staged, arena, requestFiles[r.id], r.contentHash);
+			else
+				r.staged.release();
+			for (const glm::mat4& m : placements[r.id])
+				addObject(h, m);
+		}
+		added = true;
+	}
+	if (added)
+		buildBvh();
+	return added;
+}
+
+void Scene::addObject(GeometryRegistry::Handle h, const glm::mat4& modelMat) {
+	SceneObject obj;
+	obj.geometry = h;
+	obj.modelMat = modelMat;
+	std::pair<glm::vec3, glm::vec3> bb = geometry.get(h).boundingBox();
+	transformBox(obj.modelMat, bb.first, bb.second, obj.minBB, obj.maxBB);
+	objects.push_back(obj);  // store the object
+}
+
+void Scene::buildBvh() {
+	vector<glm::vec3> minBBs(objects.size()), maxBBs(objects.size());
+	for (size_t i = 0; i < objects.size(); i++) {
+		minBBs[i] = objects[i].minBB;
+		maxBBs[i] = objects[i].maxBB;
+	}
+	bvh.build(minBBs, maxBBs);
+}
+
 glm::mat4 Scene::calModelMat(const glm::mat3 rotMat, const glm::vec3 translation) {
 	glm::mat4 modelMat = glm::mat4(1.0);  // initialize the matrix as an identity matrix
 	glm::mat4 rotateMat = glm::mat4(1.0);
@@ -7,17 +7,44 @@
 #include <iostream>
 #include <glm/glm.hpp>
 #include "mesh.hpp"
+#include "registry.hpp"
+#include "bvh.hpp"
+#include "loader.hpp"
 #include "gl_core_3_3.h"
 
+// One placement of a model in the scene; the geometry itself is shared through the registry
+struct SceneObject {
+	GeometryRegistry::Handle geometry;	// Model drawn by this object
+	glm::mat4 modelMat;					// Local to world coordinates
+	glm::vec3 minBB, maxBB;				// World-space bounding box, for culling
+};
+
 class Scene {
 public:
 	// ctor and dtor:
-	Scene() {}
+	Scene();
 	~Scene() { objects.clear(); }
 	// scene construction:
-	void parseScene();  // read ./models/scene.txt to get the rotation & translation matrices of the .obj models
+	// read ./models/scene.txt to get the rotation & translation matrices of the .obj models,
+	// and load the models in the given format (into the arena if one is given). A model name
+	// may be preceded by the word "static" for objects that never move; with batchStatic, those
+	// are merged into a few pre-transformed batches (see batch.hpp), each a single object.
+	void parseScene(Mesh::VertexFormat format = Mesh::VERTEX_FLOAT, GeometryArena* arena = nullptr,
+		bool batchStatic = false);
+	// Read the scene file, but load the models on the loader thread. Objects are added by
+	// update() as their geometry arrives; until then the scene draws what it has.
+	void beginLoad(AssetLoader& loader, Mesh::VertexFormat format = Mesh::VERTEX_FLOAT, bool batchStatic = false);
+	// Add the objects of up to maxResults meshes the loader has finished, into the arena if
+	// given. Returns whether any objects were added.
+	bool update(AssetLoader& loader, GeometryArena* arena = nullptr, size_t maxResults = 4);
+	inline bool isLoading() const { return outstanding > 0; }
 	// access:
-	inline std::vector<std::shared_ptr<Mesh>>& getSceneObjects() { return objects; }
+	inline std::vector<SceneObject>& getSceneObjects() { return objects; }
+	inline GeometryRegistry& getGeometry() { return geometry; }
+	inline const Bvh& getBvh() const { return bvh; }  // over the objects' world bounds, by object index
+	// Static objects that were merged, and the batches they were merged into
+	inline size_t getBatchedCount() const { return batchedCount; }
+	inline size_t getBatchCount() const { return batchCount; }
 	// output:
 	static void printMat3(const glm::mat3 mat);
 	static void printMat4(const glm::mat4 mat);
@@ -30,8 +57,22 @@ public:
 
 protected:
 	int nObj;  // number of objects in the scene
-	std::vector<std::shared_ptr<Mesh>> objects;  // mesh objects in the scene
+	size_t batchedCount, batchCount;  // static objects merged into batches, and the number of batches
+	std::vector<SceneObject> objects;  // objects in the scene
+	GeometryRegistry geometry;  // meshes shared by the objects
+	Bvh bvh;  // hierarchy of the objects' world bounds, for culling and spatial queries
+
+	// background loading:
+	uint32_t serial;  // tags this scene's loader requests, so results for an older scene are dropped
+	size_t outstanding;  // loader requests not finished yet
+	std::vector<std::vector<glm::mat4>> placements;  // model matrices of the objects of each request
+	std::vector<std::string> requestFiles;  // model file of each request (empty for the batches)
+	uint32_t batchRequest;  // request of the static batches (their objects are placed as they are)
 
+	// read the object list of the scene file
+	void readSceneFile(std::vector<std::string>& filenames, std::vector<glm::mat4>& modelMats, std::vector<bool>& isStatic);
+	void addObject(GeometryRegistry::Handle h, const glm::mat4& modelMat);  // place a model, computing its world bounds
+	void buildBvh();  // index the objects for culling
 	glm::mat4 calModelMat(const glm::mat3 rotMat, const glm::vec3 translation);  // calculate model matrix
 };
 
@@ -0,0 +1,245 @@
+#define NOMINMAX
+#include "shader.hpp"
+#include <iostream>
+#include <sstream>
+#include <filesystem>
+#include <stdexcept>
+#include <chrono>
+#include <algorithm>
+#include "util.hpp"
+#include "programcache.hpp"
+namespace fs = std::filesystem;
+
+// KHR_parallel_shader_compile (and the ARB extension before it) is not part of the 3.3 loader
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void (GL_APIENTRY *PFN_glMaxShaderCompilerThreads)(GLuint count);
+
+// Paths are compared in this form
+static std::string normalPath(const std::string& filename) {
+	return fs::path(filename).lexically_normal().generic_string();
+}
+
+// Insert the defines after the #version line, which has to come first, then restore the line
+// numbers of the file so compile errors point at the right place
+static std::string withDefines(const std::string& source, const std::string& defines) {
+	if (defines.empty())
+		return source;
+	size_t at = 0;
+	size_t version = source.find("#version");
+	if (version != std::string::npos) {
+		at = source.find('\n', version);
+		if (at == std::string::npos)
+			return source + "\n" + defines;
+		at++;
+	}
+	size_t line = 1 + std::count(source.begin(), source.begin() + at, '\n');
+	return source.substr(0, at) + defines + "#line " + std::to_string(line) + "\n" + source.substr(at);
+}
+
+void ShaderProgram::addStage(GLenum type, const std::string& filename) {
+	stages.push_back(Stage{ type, filename, 0 });
+}
+
+bool ShaderProgram::uses(const std::string& filename) const {
+	const std::string path = normalPath(filename);
+	for (const Stage& s : stages) {
+		if (normalPath(s.filename) == path)
+			return true;
+	}
+	return false;
+}
+
+void ShaderProgram::build() {
+	submit();
+	if (state == STATE_PENDING) {
+		std::string error = collect();
+		if (!error.empty())
+			throw std::runtime_error(error);
+		ready();
+	}
+}
+
+void ShaderProgram::submit() {
+	release();
+	submitTime = std::chrono::steady_clock::now();
+	polls = 0;
+	std::vector<std::string> sources;
+	for (const Stage& s : stages)
+		sources.push_back(readShaderFile(s.filename));
+	cacheKey = programCacheKey(sources, defines);
+
+	// A cached binary of the same sources on the same driver skips compiling altogether; the
+	// stages are then compiled only if a file changes later
+	fromCache = false;
+	if (!cacheDir.empty()) {
+		program = readProgramCache(cacheDir, cacheKey);
+		fromCache = program != 0;
+		if (fromCache) {
+			ready();
+			return;
+		}
+	}
+
+	// Nothing is queried here, so none of these calls waits for the compiler
+	parallelCompileSupported();  // lets the driver use its threads for these too
+	program = glCreateProgram();
+	if (!cacheDir.empty())
+		setProgramRetrievable(program);
+	for (size_t i = 0; i < stages.size(); i++) {
+		const std::string source = withDefines(sources[i], defines);
+		const char* text = source.c_str();
+		stages[i].shader = glCreateShader(stages[i].type);
+		glShaderSource(stages[i].shader, 1, &text, NULL);
+		glCompileShader(stages[i].shader);
+		glAttachShader(program, stages[i].shader);
+	}
+	glLinkProgram(program);
+	state = STATE_PENDING;
+}
+
+bool ShaderProgram::poll() {
+	if (state != STATE_PENDING)
+		return false;
+	polls++;
+	if (parallelCompileSupported()) {
+		GLint done = GL_FALSE;
+		glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &done);
+		if (done == GL_FALSE)
+			return false;
+	} else if (polls < 2) {
+		return false;
+	}
+
+	std::string error = collect();
+	if (!error.empty()) {
+		std::cerr << error << "Drawing without the program until its files are fixed" << std::endl;
+		return false;
+	}
+	ready();
+	return true;
+}
+
+std::string ShaderProgram::collect() {
+	GLint status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	for (const Stage& s : stages)
+		glDetachShader(program, s.shader);
+	if (status != GL_FALSE) {
+		if (!cacheDir.empty())
+			writeProgramCache(cacheDir, cacheKey, program);
+		return std::string();
+	}
+
+	// A stage that did not compile explains the failure better than the link log
+	std::stringstream ss;
+	for (const Stage& s : stages) {
+		GLint compiled = GL_FALSE;
+		glGetShaderiv(s.shader, GL_COMPILE_STATUS, &compiled);
+		if (compiled == GL_FALSE)
+			ss << "Error compiling " << s.filename << ":" << std::endl << std::endl << shaderInfoLog(s.shader) << std::endl;
+	}
+	if (ss.str().empty())
+		ss << "Error linking shader program:" << std::endl << std::endl << programInfoLog(program) << std::endl;
+	release();
+	state = STATE_FAILED;
+	return ss.str();
+}
+
+void ShaderProgram::ready() {
+	state = STATE_READY;
+	buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submitTime).count();
+	linked();
+}
+
+void ShaderProgram::linked() {
+	uniformLocs.resize(uniformNames.size());
+	for (size_t i = 0; i < uniformNames.size(); i++)
+		uniformLocs[i] = glGetUniformLocation(program, uniformNames[i].c_str());
+	if (onLink)
+		onLink(program);
+}
+
+bool ShaderProgram::reload(const std::vector<std::string>& changedFiles) {
+	// A build still in flight is settled first; if it failed, every stage is compiled again
+	if (state == STATE_PENDING) {
+		std::string error = collect();
+		if (error.empty())
+			ready();
+		else
+			std::cerr << error;
+	}
+
+	// Compile the changed stages (and any not compiled yet) on the side; the others are
+	// linked as they are
+	std::vector<GLuint> fresh(stages.size(), 0), shaders(stages.size());
+	std::vector<std::string> sources(stages.size());
+	GLuint newProgram = 0;
+	try {
+		for (size_t i = 0; i < stages.size(); i++) {
+			sources[i] = readShaderFile(stages[i].filename);
+			bool changed = stages[i].shader == 0;
+			for (const std::string& f : changedFiles)
+				changed = changed || normalPath(f) == normalPath(stages[i].filename);
+			if (changed)
+				fresh[i] = compileShaderSource(stages[i].type, withDefines(sources[i], defines), stages[i].filename);
+			shaders[i] = fresh[i] ? fresh[i] : stages[i].shader;
+		}
+		newProgram = link(shaders, sources);
+	} catch (const std::exception& e) {
+		for (GLuint s : fresh) {
+			if (s) glDeleteShader(s);
+		}
+		std::cerr << e.what() << "Keeping the previous program" << std::endl;
+		return false;
+	}
+
+	// Swap in the new program and the stages it was linked from
+	glDeleteProgram(program);
+	program = newProgram;
+	state = STATE_READY;
+	for (size_t i = 0; i < stages.size(); i++) {
+		if (fresh[i]) {
+			if (stages[i].shader)
+				glDeleteShader(stages[i].shader);
+			stages[i].shader = fresh[i];
+		}
+	}
+	linked();
+	return true;
+}
+
+GLuint ShaderProgram::link(std::vector<GLuint>& shaders, const std::vector<std::string>& sources) {
+	if (cacheDir.empty())
+		return linkProgram(shaders);
+	GLuint p = glCreateProgram();
+	setProgramRetrievable(p);
+	p = linkProgram(shaders, p);
+	writeProgramCache(cacheDir, programCacheKey(sources, defines), p);
+	return p;
+}
+
+void ShaderProgram::release() {
+	for (Stage& s : stages) {
+		if (s.shader) { glDeleteShader(s.shader); s.shader = 0; }
+	}
+	if (program) { glDeleteProgram(program); program = 0; }
+	state = STATE_EMPTY;
+}
+
+bool ShaderProgram::parallelCompileSupported() {
+	static int supported = -1;
+	if (supported < 0) {
+		const char* fn = nullptr;
+		if (hasExtension("GL_KHR_parallel_shader_compile"))
+			fn = "glMaxShaderCompilerThreadsKHR";
+		else if (hasExtension("GL_ARB_parallel_shader_compile"))
+			fn = "glMaxShaderCompilerThreadsARB";
+		PFN_glMaxShaderCompilerThreads maxThreads = fn ? (PFN_glMaxShaderCompilerThreads)getProcAddress(fn) : nullptr;
+		if (maxThreads)
+			maxThreads(0xFFFFFFFF);  // as many as the driver sees fit
+		supported = fn != nullptr;
+	}
+	return supported > 0;
+}
@@ -0,0 +1,111 @@
+#ifndef SHADER_HPP
+#define SHADER_HPP
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+#include "gl_core_3_3.h"
+
+// A GPU program linked from shader files. The compiled stages are kept, so when some of the
+// files change only their stages are compiled again before relinking.
+//
+// A build can be submitted without waiting for it: the driver compiles and links while frames
+// are drawn with something else, and poll() collects the result. Drivers with
+// KHR_parallel_shader_compile do that work on their own threads and say when it is done.
+class ShaderProgram {
+public:
+	enum State {
+		STATE_EMPTY,	// Not built
+		STATE_PENDING,	// Submitted, the driver may still be compiling
+		STATE_READY,	// Linked, id() can be drawn with
+		STATE_FAILED,	// Did not compile or link; the error was printed
+	};
+
+	ShaderProgram() : program(0), state(STATE_EMPTY), cacheKey(0), polls(0), buildMs(0.0), fromCache(false) {}
+	~ShaderProgram() { release(); }
+	// Disallow copy, move, & assignment
+	ShaderProgram(const ShaderProgram& other) = delete;
+	ShaderProgram& operator=(const ShaderProgram& other) = delete;
+	ShaderProgram(ShaderProgram&& other) = delete;
+	ShaderProgram& operator=(ShaderProgram&& other) = delete;
+
+	// Add a stage; takes effect on the next build()
+	void addStage(GLenum type, const std::string& filename);
+	// Called with the program after every successful link, to connect its uniform blocks and
+	// samplers and to look up uniform locations (which may change with every link)
+	inline void setOnLink(const std::function<void(GLuint)>& fn) { onLink = fn; }
+	// Uniforms whose locations are looked up after every link, before onLink (see location())
+	inline void setUniforms(const std::vector<std::string>& names) { uniformNames = names; }
+	// Keep linked binaries in <dir>/.programcache (see programcache.hpp) and load them instead
+	// of compiling when nothing changed; an empty dir disables the cache
+	inline void setCacheDir(const std::string& dir) { cacheDir = dir; }
+	// Lines (e.g. "#define X\n") inserted after the #version line of every stage; they are part
+	// of the cache key. Takes effect on the next build.
+	inline void setDefines(const std::string& text) { defines = text; }
+
+	// Compile every stage and link, waiting for the result. Throws std::runtime_error with the
+	// log on failure.
+	void build();
+	// Start compiling every stage and linking, and return without waiting. A binary from the
+	// cache is ready at once.
+	void submit();
+	// Collect a submitted build if the driver is done with it. Without the parallel compile
+	// extension there is no asking, so the build is collected on the second call, after the
+	// driver had a frame's time. Returns true only on the call that makes the program ready.
+	bool poll();
+	// Compile again the stages read from any of the given files, and relink. The new program
+	// replaces the current one only if all of that succeeds; otherwise the error is printed
+	// and the current one stays in use. Returns whether the program was replaced.
+	bool reload(const std::vector<std::string>& changedFiles);
+
+	// access:
+	inline GLuint id() const { return state == STATE_READY ? program : 0; }
+	inline State getState() const { return state; }
+	inline bool isReady() const { return state == STATE_READY; }
+	// Location of the i-th uniform given to setUniforms() in the current program, -1 if it
+	// has none by that name
+	inline GLint location(size_t i) const { return uniformLocs.at(i); }
+	bool uses(const std::string& filename) const;  // Whether a stage is read from the file
+	// Whether the driver compiles on its own threads and reports when it is done
+	// (KHR_parallel_shader_compile). Checked once, on the GL thread.
+	static bool parallelCompileSupported();
+	// How long the last build took from submitting to ready, and whether it loaded a cached binary
+	inline double getBuildMs() const { return buildMs; }
+	inline bool isFromCache() const { return fromCache; }
+
+protected:
+	struct Stage {
+		GLenum type;
+		std::string filename;
+		GLuint shader;		// Last successfully compiled shader object, 0 if not compiled yet
+	};
+	void release();
+	// Link the compiled stages into a new program, storing its binary if the cache is used.
+	// sources are the texts of the files the stages were compiled from.
+	GLuint link(std::vector<GLuint>& shaders, const std::vector<std::string>& sources);
+	// Check the outcome of the submitted build, which blocks if the driver is not done yet.
+	// Returns the error log if it failed, which also releases the program.
+	std::string collect();
+	// Mark the program ready and hand it to linked()
+	void ready();
+	// Look up the uniform locations of a newly linked program and hand it to onLink
+	void linked();
+
+	std::vector<Stage> stages;
+	GLuint program;		// Linked program (or one being linked), 0 before a build
+	State state;
+	std::function<void(GLuint)> onLink;
+	std::vector<std::string> uniformNames;
+	std::vector<GLint> uniformLocs;		// Of uniformNames in program
+	std::string cacheDir;	// Where binaries are cached, empty for none
+	std::string defines;	// Inserted into every stage
+	uint64_t cacheKey;		// Key of the sources of the submitted build
+	unsigned polls;			// Calls to poll() since submit()
+	std::chrono::steady_clock::time_point submitTime;
+	double buildMs;
+	bool fromCache;
+};
+
+#endif
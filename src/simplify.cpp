@@ -0,0 +1,374 @@
+#define NOMINMAX
+#include "simplify.hpp"
+#include <algorithm>
+#include <numeric>
+#include <queue>
+#include <unordered_map>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+
+// Weight of the planes that pin border and seam edges, relative to a face plane
+static const double seamWeight = 10.0;
+// Smallest cosine allowed between a triangle's normal before and after a collapse
+static const double minFlipCos = 0.2;
+
+// Sum of squared distances to a set of planes, as a symmetric 4x4 matrix
+struct Quadric {
+	double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+	Quadric() : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0) {}
+	// Plane n.x + d = 0 with unit normal n
+	void addPlane(glm::dvec3 n, double d, double w) {
+		a2 += w * n.x * n.x; ab += w * n.x * n.y; ac += w * n.x * n.z; ad += w * n.x * d;
+		b2 += w * n.y * n.y; bc += w * n.y * n.z; bd += w * n.y * d;
+		c2 += w * n.z * n.z; cd += w * n.z * d;
+		d2 += w * d * d;
+	}
+	Quadric& operator+=(const Quadric& o) {
+		a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad; b2 += o.b2;
+		bc += o.bc; bd += o.bd; c2 += o.c2; cd += o.cd; d2 += o.d2;
+		return *this;
+	}
+	double eval(glm::dvec3 p) const {
+		double e = a2 * p.x * p.x + b2 * p.y * p.y + c2 * p.z * p.z
+			+ 2.0 * (ab * p.x * p.y + ac * p.x * p.z + bc * p.y * p.z)
+			+ 2.0 * (ad * p.x + bd * p.y + cd * p.z) + d2;
+		return std::max(e, 0.0);
+	}
+};
+
+// Collapse of one position onto another, ordered by cost in the queue
+struct Collapse {
+	double cost;
+	uint32_t from, to;
+	uint32_t fromStamp, toStamp;	// Stamps of the two positions when the cost was computed
+	bool operator>(const Collapse& o) const { return cost > o.cost; }
+};
+
+std::vector<GLuint> simplifyMesh(const std::vector<Mesh::Vertex>& vertices,
+	const std::vector<GLuint>& indices, size_t targetTris, float& error) {
+	error = 0.0f;
+	const size_t triCount = indices.size() / 3;
+	if (triCount <= targetTris)
+		return indices;
+
+	// Vertices (wedges) with the same position share one position id
+	std::vector<uint32_t> order(vertices.size());
+	std::iota(order.begin(), order.end(), 0u);
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+		return memcmp(&vertices[a].pos, &vertices[b].pos, sizeof(glm::vec3)) < 0;
+	});
+	std::vector<uint32_t> posOf(vertices.size());
+	std::vector<glm::dvec3> P;
+	for (size_t i = 0; i < order.size(); i++) {
+		if (i == 0 || memcmp(&vertices[order[i]].pos, &vertices[order[i - 1]].pos, sizeof(glm::vec3)) != 0)
+			P.push_back(glm::dvec3(vertices[order[i]].pos));
+		posOf[order[i]] = (uint32_t)P.size() - 1;
+	}
+	const size_t posCount = P.size();
+
+	// Triangles as wedge triples, and the triangles around each position
+	std::vector<GLuint> tris(indices);
+	std::vector<char> alive(triCount, 1);
+	std::vector<std::vector<uint32_t>> posTris(posCount);
+	size_t aliveCount = 0;
+	for (size_t t = 0; t < triCount; t++) {
+		uint32_t a = posOf[tris[3 * t]], b = posOf[tris[3 * t + 1]], c = posOf[tris[3 * t + 2]];
+		if (a == b || b == c || a == c) {
+			alive[t] = 0;  // degenerate
+			continue;
+		}
+		posTris[a].push_back((uint32_t)t);
+		posTris[b].push_back((uint32_t)t);
+		posTris[c].push_back((uint32_t)t);
+		aliveCount++;
+	}
+	auto faceNormal = [&](size_t t) {
+		glm::dvec3 a = P[posOf[tris[3 * t]]], b = P[posOf[tris[3 * t + 1]]], c = P[posOf[tris[3 * t + 2]]];
+		return glm::cross(b - a, c - a);
+	};
+
+	// Face planes, plus planes through border and seam edges perpendicular to their face
+	std::vector<Quadric> Q(posCount);
+	struct EdgeUse { uint32_t tri, wa, wb, far, uses; bool pinned; };
+	std::unordered_map<uint64_t, EdgeUse> edges;
+	edges.reserve(aliveCount * 2);
+	for (size_t t = 0; t < triCount; t++) {
+		if (!alive[t])
+			continue;
+		glm::dvec3 n = faceNormal(t);
+		double len = glm::length(n);
+		if (len > 0.0) {
+			n /= len;
+			double d = -glm::dot(n, P[posOf[tris[3 * t]]]);
+			for (int k = 0; k < 3; k++)
+				Q[posOf[tris[3 * t + k]]].addPlane(n, d, 1.0);
+		}
+		for (int k = 0; k < 3; k++) {
+			uint32_t wa = tris[3 * t + k], wb = tris[3 * t + (k + 1) % 3];
+			if (posOf[wa] > posOf[wb])
+				std::swap(wa, wb);
+			uint64_t key = (uint64_t(posOf[wa]) << 32) | posOf[wb];
+			uint32_t far = posOf[tris[3 * t + (k + 2) % 3]];
+			auto found = edges.find(key);
+			if (found == edges.end()) {
+				edges.emplace(key, EdgeUse{ (uint32_t)t, wa, wb, far, 1, false });
+			} else {
+				// Pin seams, and the back face of a two-sided triangle, which is really a border
+				found->second.uses++;
+				if (found->second.wa != wa || found->second.wb != wb || found->second.far == far)
+					found->second.pinned = true;
+			}
+		}
+	}
+	for (auto& e : edges) {
+		if (e.second.uses == 2 && !e.second.pinned)
+			continue;
+		uint32_t a = posOf[e.second.wa], b = posOf[e.second.wb];
+		glm::dvec3 n = glm::cross(P[b] - P[a], faceNormal(e.second.tri));
+		double len = glm::length(n);
+		if (len == 0.0)
+			continue;
+		n /= len;
+		double d = -glm::dot(n, P[a]);
+		Q[a].addPlane(n, d, seamWeight);
+		Q[b].addPlane(n, d, seamWeight);
+	}
+
+	// Queue both directions of every edge
+	std::vector<uint32_t> stamp(posCount, 0);
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+	auto pushEdge = [&](uint32_t a, uint32_t b) {
+		Quadric q = Q[a];
+		q += Q[b];
+		queue.push(Collapse{ q.eval(P[b]), a, b, stamp[a], stamp[b] });
+		queue.push(Collapse{ q.eval(P[a]), b, a, stamp[b], stamp[a] });
+	};
+	for (auto& e : edges)
+		pushEdge(uint32_t(e.first >> 32), uint32_t(e.first & 0xFFFFFFFFu));
+	edges.clear();
+
+	// Check a collapse of position p onto q. Every wedge of p must map onto the wedge of q it
+	// shares a triangle with, which keeps attribute seams intact.
+	std::vector<std::pair<GLuint, GLuint>> wedgeMap;
+	std::vector<uint32_t> ringP, ringQ, opposite;
+	auto canCollapse = [&](uint32_t p, uint32_t q) {
+		wedgeMap.clear();
+		opposite.clear();
+		ringP.clear();
+		ringQ.clear();
+		size_t shared = 0;
+		for (uint32_t t : posTris[p]) {
+			int kp = -1, kq = -1;
+			for (int k = 0; k < 3; k++) {
+				uint32_t pos = posOf[tris[3 * t + k]];
+				if (pos == p) kp = k;
+				else if (pos == q) kq = k;
+				else ringP.push_back(pos);
+			}
+			if (kq < 0)
+				continue;
+			shared++;
+			opposite.push_back(posOf[tris[3 * t + 3 - kp - kq]]);
+			GLuint wp = tris[3 * t + kp], wq = tris[3 * t + kq];
+			auto m = std::find_if(wedgeMap.begin(), wedgeMap.end(), [&](const std::pair<GLuint, GLuint>& e) { return e.first == wp; });
+			if (m == wedgeMap.end())
+				wedgeMap.push_back(std::make_pair(wp, wq));
+			else if (m->second != wq)
+				return false;
+		}
+		if (shared == 0)
+			return false;  // no longer an edge
+
+		for (uint32_t t : posTris[p]) {
+			int kp = -1;
+			bool hasQ = false;
+			for (int k = 0; k < 3; k++) {
+				uint32_t pos = posOf[tris[3 * t + k]];
+				if (pos == p) kp = k;
+				else if (pos == q) hasQ = true;
+			}
+			if (hasQ)
+				continue;
+			GLuint wp = tris[3 * t + kp];
+			if (std::find_if(wedgeMap.begin(), wedgeMap.end(), [&](const std::pair<GLuint, GLuint>& e) { return e.first == wp; }) == wedgeMap.end())
+				return false;  // a wedge of p that has no counterpart at q
+
+			// Reject triangles that would fold over or collapse to a sliver
+			glm::dvec3 before = faceNormal(t);
+			glm::dvec3 corner[3];
+			for (int k = 0; k < 3; k++)
+				corner[k] = (k == kp) ? P[q] : P[posOf[tris[3 * t + k]]];
+			glm::dvec3 after = glm::cross(corner[1] - corner[0], corner[2] - corner[0]);
+			double lb = glm::length(before), la = glm::length(after);
+			if (la <= 1e-12 * lb || glm::dot(before, after) < minFlipCos * lb * la)
+				return false;
+		}
+
+		// Link condition: p and q may only share the far corners of their shared triangles.
+		// Those are counted by position, so two-sided surfaces (each face twice) pass too.
+		for (uint32_t t : posTris[q]) {
+			for (int k = 0; k < 3; k++) {
+				uint32_t pos = posOf[tris[3 * t + k]];
+				if (pos != p && pos != q)
+					ringQ.push_back(pos);
+			}
+		}
+		std::sort(ringP.begin(), ringP.end());
+		ringP.erase(std::unique(ringP.begin(), ringP.end()), ringP.end());
+		std::sort(ringQ.begin(), ringQ.end());
+		ringQ.erase(std::unique(ringQ.begin(), ringQ.end()), ringQ.end());
+		size_t common = 0;
+		for (size_t i = 0, j = 0; i < ringP.size() && j < ringQ.size();) {
+			if (ringP[i] < ringQ[j]) i++;
+			else if (ringQ[j] < ringP[i]) j++;
+			else { common++; i++; j++; }
+		}
+		std::sort(opposite.begin(), opposite.end());
+		return common == size_t(std::unique(opposite.begin(), opposite.end()) - opposite.begin());
+	};
+
+	double maxCost = 0.0;
+	std::vector<uint32_t> neighbors;
+	while (aliveCount > targetTris && !queue.empty()) {
+		Collapse c = queue.top();
+		queue.pop();
+		if (stamp[c.from] != c.fromStamp || stamp[c.to] != c.toStamp)
+			continue;  // superseded by a later entry
+		const uint32_t p = c.from, q = c.to;
+		if (!canCollapse(p, q))
+			continue;
+
+		// Move p onto q: triangles on the edge vanish, the rest switch to q's wedges
+		maxCost = std::max(maxCost, c.cost);
+		Q[q] += Q[p];
+		for (uint32_t t : posTris[p]) {
+			bool hasQ = false;
+			int kp = -1;
+			for (int k = 0; k < 3; k++) {
+				uint32_t pos = posOf[tris[3 * t + k]];
+				if (pos == p) kp = k;
+				else if (pos == q) hasQ = true;
+			}
+			if (hasQ) {
+				alive[t] = 0;
+				aliveCount--;
+				continue;
+			}
+			GLuint wp = tris[3 * t + kp];
+			for (auto& m : wedgeMap) {
+				if (m.first == wp)
+					tris[3 * t + kp] = m.second;
+			}
+			posTris[q].push_back(t);
+		}
+		posTris[p].clear();
+		stamp[p]++;
+		stamp[q]++;
+
+		// Drop the vanished triangles around q and its neighbors, then requeue q's edges
+		neighbors.clear();
+		auto& listQ = posTris[q];
+		listQ.erase(std::remove_if(listQ.begin(), listQ.end(), [&](uint32_t t) { return !alive[t]; }), listQ.end());
+		for (uint32_t t : listQ) {
+			for (int k = 0; k < 3; k++) {
+				uint32_t pos = posOf[tris[3 * t + k]];
+				if (pos != q)
+					neighbors.push_back(pos);
+			}
+		}
+		std::sort(neighbors.begin(), neighbors.end());
+		neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+		for (uint32_t r : neighbors) {
+			auto& list = posTris[r];
+			list.erase(std::remove_if(list.begin(), list.end(), [&](uint32_t t) { return !alive[t]; }), list.end());
+			pushEdge(q, r);
+		}
+	}
+
+	std::vector<GLuint> result;
+	result.reserve(aliveCount * 3);
+	for (size_t t = 0; t < triCount; t++) {
+		if (alive[t])
+			result.insert(result.end(), tris.begin() + 3 * t, tris.begin() + 3 * t + 3);
+	}
+	error = (float)std::sqrt(maxCost);
+	return result;
+}
+
+// Whether every corner's normal is its triangle's face normal, i.e. the reader computed them
+static bool hasFaceNormals(const Mesh::Geometry& geom) {
+	for (size_t i = 0; i + 2 < geom.indices.size(); i += 3) {
+		const Mesh::Vertex& a = geom.vertices[geom.indices[i]];
+		const Mesh::Vertex& b = geom.vertices[geom.indices[i + 1]];
+		const Mesh::Vertex& c = geom.vertices[geom.indices[i + 2]];
+		glm::vec3 n = glm::cross(b.pos - a.pos, c.pos - a.pos);
+		float len = glm::length(n);
+		if (len == 0.0f)
+			continue;
+		n /= len;
+		const float eps = 1e-6f;  // the readers store exactly this, up to rounding
+		if (glm::any(glm::greaterThan(glm::abs(n - a.norm), glm::vec3(eps))) ||
+			glm::any(glm::greaterThan(glm::abs(n - b.norm), glm::vec3(eps))) ||
+			glm::any(glm::greaterThan(glm::abs(n - c.norm), glm::vec3(eps))))
+			return false;
+	}
+	return true;
+}
+
+void buildLods(Mesh::Geometry& geom) {
+	geom.lods.assign(1, Mesh::Lod{ 0, (GLuint)geom.indices.size(), 0.0f });
+	if (geom.indices.size() / 3 < 2 * minLodTriangles)
+		return;
+
+	// Face normals are not worth keeping seams for: simplify the positions and colors only,
+	// and give each level new flat-shaded vertices
+	const bool faceNormals = hasFaceNormals(geom);
+	Mesh::Geometry work;
+	if (faceNormals) {
+		work.vertices.resize(geom.indices.size());
+		for (size_t i = 0; i < geom.indices.size(); i++) {
+			work.vertices[i] = geom.vertices[geom.indices[i]];
+			work.vertices[i].norm = glm::vec3(0.0f);
+		}
+		Mesh::weld(work);
+	} else {
+		work.indices = geom.indices;
+	}
+	const std::vector<Mesh::Vertex>& workVerts = faceNormals ? work.vertices : geom.vertices;
+
+	std::vector<GLuint> current = work.indices;
+	float error = 0.0f;
+	while (geom.lods.size() < maxLodCount) {
+		const size_t tris = current.size() / 3;
+		if (tris < 2 * minLodTriangles)
+			break;
+		float stepError;
+		std::vector<GLuint> next = simplifyMesh(workVerts, current, tris / 2, stepError);
+		if (next.size() / 3 > tris * 3 / 4)
+			break;  // stuck on seams and borders
+		if (error + stepError > maxLodError * glm::length(geom.maxBB - geom.minBB))
+			break;  // no longer resembles the model
+		error += stepError;  // each level is measured against the one before
+
+		Mesh::Lod lod{ (GLuint)geom.indices.size(), (GLuint)next.size(), error };
+		if (faceNormals) {
+			for (size_t i = 0; i < next.size(); i += 3) {
+				Mesh::Vertex corner[3] = { workVerts[next[i]], workVerts[next[i + 1]], workVerts[next[i + 2]] };
+				glm::vec3 n = glm::cross(corner[1].pos - corner[0].pos, corner[2].pos - corner[0].pos);
+				float len = glm::length(n);
+				n = len > 0.0f ? n / len : glm::vec3(0.0f, 1.0f, 0.0f);
+				for (int k = 0; k < 3; k++) {
+					corner[k].norm = n;
+					geom.indices.push_back((GLuint)geom.vertices.size());
+					geom.vertices.push_back(corner[k]);
+				}
+			}
+		} else {
+			geom.indices.insert(geom.indices.end(), next.begin(), next.end());
+		}
+		geom.lods.push_back(lod);
+		current.swap(next);
+	}
+}
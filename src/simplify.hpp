@@ -0,0 +1,26 @@
+#ifndef SIMPLIFY_HPP
+#define SIMPLIFY_HPP
+
+#include <vector>
+#include <cstddef>
+#include "mesh.hpp"
+
+// Limits of the LOD chain built by buildLods
+const size_t maxLodCount = 6;		// Including the full-detail mesh
+const size_t minLodTriangles = 64;	// No level is simplified below this
+const float maxLodError = 0.25f;	// Largest error of a level, as a fraction of the bounding box diagonal
+
+// Collapse edges of an indexed triangle list, using quadric error metrics, until at most
+// targetTris triangles remain or no collapse is allowed. Vertices only ever move onto other
+// existing vertices, so the result indexes the same vertex array. Borders and edges where
+// normals or colors are discontinuous are kept in place. error receives the largest distance
+// (model units, approximate) between the result and the input.
+std::vector<GLuint> simplifyMesh(const std::vector<Mesh::Vertex>& vertices,
+	const std::vector<GLuint>& indices, size_t targetTris, float& error);
+
+// Fill geom.lods with a chain of levels, each with about half the triangles of the one before.
+// The levels are appended to geom.indices. Meshes whose normals were computed per face are
+// simplified by position and get new flat-shaded vertices appended to geom.vertices.
+void buildLods(Mesh::Geometry& geom);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef SPSCQUEUE_HPP
+#define SPSCQUEUE_HPP
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// Bounded lock-free queue between exactly one producer thread and one consumer thread.
+// Items are moved into preallocated slots; the consumer can look at the front item before
+// deciding to take it.
+template <typename T>
+class SpscQueue {
+public:
+	// Capacity is rounded up to a power of two
+	explicit SpscQueue(size_t capacity) : head(0), tail(0) {
+		size_t n = 2;
+		while (n < capacity)
+			n <<= 1;
+		slots.resize(n);
+		mask = n - 1;
+	}
+	// Disallow copy, move, & assignment
+	SpscQueue(const SpscQueue& other) = delete;
+	SpscQueue& operator=(const SpscQueue& other) = delete;
+	SpscQueue(SpscQueue&& other) = delete;
+	SpscQueue& operator=(SpscQueue&& other) = delete;
+
+	// producer: append an item, or return false (leaving it untouched) if the queue is full
+	bool push(T&& item) {
+		const size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) > mask)
+			return false;
+		slots[t & mask] = std::move(item);
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	// consumer: the oldest item, or nullptr if the queue is empty
+	T* front() {
+		const size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire))
+			return nullptr;
+		return &slots[h & mask];
+	}
+	// consumer: remove the front item (which must exist), after moving out of it
+	void pop() {
+		const size_t h = head.load(std::memory_order_relaxed);
+		slots[h & mask] = T();
+		head.store(h + 1, std::memory_order_release);
+	}
+
+	// Approximate when called from neither end
+	inline bool empty() const { return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire); }
+	inline size_t capacity() const { return slots.size(); }
+
+protected:
+	std::vector<T> slots;
+	size_t mask;		// slots.size() - 1
+	// Indices only grow; each is written by one side, on its own cache line
+	alignas(64) std::atomic<size_t> head;	// Next item to take (consumer)
+	alignas(64) std::atomic<size_t> tail;	// Next slot to fill (producer)
+};
+
+#endif
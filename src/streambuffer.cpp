@@ -0,0 +1,134 @@
+#define NOMINMAX
+#include "streambuffer.hpp"
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include "util.hpp"
+
+// ARB_buffer_storage (core in GL 4.4) is not part of the 3.3 loader
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+typedef void (GL_APIENTRY *PFN_glBufferStorage)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+StreamBuffer::StreamBuffer(size_t size, size_t frames) :
+	buf(0),
+	capacity(size),
+	mapped(nullptr),
+	head(0),
+	segmentBegin(0),
+	fences(frames + 1),  // one fence per frame, plus the extra one a wrap around splits a frame into
+	oldest(0),
+	pendingCount(0),
+	stalls(0),
+	stallMs(0.0) {
+	// Writes go through the copy-write target so they never disturb other bindings
+	glGenBuffers(1, &buf);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buf);
+	PFN_glBufferStorage bufferStorage = hasExtension("GL_ARB_buffer_storage") ?
+		(PFN_glBufferStorage)getProcAddress("glBufferStorage") : nullptr;
+	if (bufferStorage) {
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		bufferStorage(GL_COPY_WRITE_BUFFER, capacity, NULL, flags);
+		mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, capacity, flags);
+	}
+	if (!mapped)
+		glBufferData(GL_COPY_WRITE_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+StreamBuffer::~StreamBuffer() {
+	for (size_t i = 0; i < pendingCount; i++)
+		glDeleteSync(pending(i).fence);
+	if (mapped) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buf);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	if (buf) glDeleteBuffers(1, &buf);
+}
+
+size_t StreamBuffer::write(const void* data, size_t bytes, size_t alignment) {
+	if (bytes > capacity) {
+		std::stringstream ss;
+		ss << "Stream buffer write of " << bytes << " bytes exceeds its " << capacity << " bytes" << std::endl;
+		throw std::runtime_error(ss.str());
+	}
+	size_t offset = (head + alignment - 1) / alignment * alignment;
+	if (offset + bytes > capacity) {
+		// Wrap around; what was written this frame gets its own fence so it is not overwritten
+		fence();
+		offset = 0;
+		segmentBegin = 0;
+	}
+
+	// Retire the ranges the GPU has finished with, then wait for the newest one still in the way
+	while (pendingCount) {
+		GLenum status = glClientWaitSync(pending(0).fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+		glDeleteSync(pending(0).fence);
+		oldest = (oldest + 1) % fences.size();
+		pendingCount--;
+	}
+	for (size_t i = pendingCount; i-- > 0;) {
+		if (pending(i).begin < offset + bytes && offset < pending(i).end) {
+			waitFor(i);
+			break;
+		}
+	}
+
+	if (mapped) {
+		memcpy(mapped + offset, data, bytes);
+	} else if (bytes) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buf);
+		void* dst = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, bytes,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (dst) {
+			memcpy(dst, data, bytes);
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		} else {
+			glBufferSubData(GL_COPY_WRITE_BUFFER, offset, bytes, data);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	head = offset + bytes;
+	return offset;
+}
+
+void StreamBuffer::endFrame() {
+	fence();
+	segmentBegin = head;
+}
+
+void StreamBuffer::fence() {
+	if (head <= segmentBegin)
+		return;  // nothing written
+	// More wraps than the ring was sized for (e.g. frames larger than expected)
+	if (pendingCount == fences.size())
+		waitFor(0);
+	pending(pendingCount) = Fenced{ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), segmentBegin, head };
+	pendingCount++;
+}
+
+void StreamBuffer::waitFor(size_t index) {
+	using clock = std::chrono::steady_clock;
+	GLsync fence = pending(index).fence;
+	if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+		auto t0 = clock::now();
+		GLenum status;
+		do {
+			status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);  // 1 s
+		} while (status == GL_TIMEOUT_EXPIRED);
+		stalls++;
+		stallMs += std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+	}
+	for (size_t i = 0; i <= index; i++)
+		glDeleteSync(pending(i).fence);
+	oldest = (oldest + index + 1) % fences.size();
+	pendingCount -= index + 1;
+}
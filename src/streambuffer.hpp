@@ -0,0 +1,61 @@
+#ifndef STREAMBUFFER_HPP
+#define STREAMBUFFER_HPP
+
+#include <vector>
+#include <cstddef>
+#include "gl_core_3_3.h"
+
+// Ring buffer for data that is rewritten every frame (instance transforms, dynamic geometry).
+// Writes go to space the GPU is done with, found through a fence placed behind each frame's
+// data, so uploads never wait on the driver's implicit synchronization. With
+// ARB_buffer_storage the buffer stays mapped for its whole lifetime; otherwise each write maps
+// its range unsynchronized.
+class StreamBuffer {
+public:
+	// frames is how many frames of data the ring holds; the fences in flight are kept in a
+	// ring of their own sized for that, so writing never allocates
+	StreamBuffer(size_t size, size_t frames);
+	~StreamBuffer();
+	// Disallow copy, move, & assignment
+	StreamBuffer(const StreamBuffer& other) = delete;
+	StreamBuffer& operator=(const StreamBuffer& other) = delete;
+	StreamBuffer(StreamBuffer&& other) = delete;
+	StreamBuffer& operator=(StreamBuffer&& other) = delete;
+
+	// Copy bytes (at most size()) into the ring and return their offset, a multiple of alignment.
+	// Blocks, counting a stall, only if the GPU may still be reading that space.
+	size_t write(const void* data, size_t bytes, size_t alignment = 16);
+	// Fence the data written since the last call; call after the frame's draws are issued
+	void endFrame();
+
+	// access:
+	inline GLuint buffer() const { return buf; }
+	inline size_t size() const { return capacity; }
+	inline bool isPersistent() const { return mapped != nullptr; }
+	// Writes that had to wait for the GPU, and the total time they waited
+	inline size_t getStalls() const { return stalls; }
+	inline double getStallMs() const { return stallMs; }
+
+protected:
+	// A range of the ring, in use by the GPU until its fence signals
+	struct Fenced {
+		GLsync fence;
+		size_t begin, end;
+	};
+	void fence();				// Fence [segmentBegin, head), first waiting for the oldest if none is free
+	void waitFor(size_t index);	// Wait for the index-th oldest (and all older), then retire them
+	inline Fenced& pending(size_t index) { return fences[(oldest + index) % fences.size()]; }
+
+	GLuint buf;
+	size_t capacity;
+	unsigned char* mapped;		// Persistent mapping, or nullptr
+	size_t head;				// Where the next write goes
+	size_t segmentBegin;		// Start of the data not fenced yet
+	std::vector<Fenced> fences;	// Ring of the fenced ranges in flight
+	size_t oldest;				// Index of the oldest in fences
+	size_t pendingCount;		// Number in flight
+	size_t stalls;
+	double stallMs;
+};
+
+#endif
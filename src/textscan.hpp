@@ -0,0 +1,94 @@
+#ifndef TEXTSCAN_HPP
+#define TEXTSCAN_HPP
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <stdexcept>
+#include <cstring>
+#include <charconv>
+#include <system_error>
+
+// In-place scanning helpers for text model formats (OBJ, ASCII PLY).
+// The scanners work on a [p, end) byte range and only allocate to report an error.
+
+// Horizontal whitespace (the newline is a record separator, not whitespace)
+inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+inline const char* skipBlanks(const char* p, const char* end) {
+	while (p < end && isBlank(*p)) ++p;
+	return p;
+}
+
+inline const char* skipToken(const char* p, const char* end) {
+	while (p < end && !isBlank(*p) && *p != '\n') ++p;
+	return p;
+}
+
+// Find the end of the current line; memchr is a vectorized scan in every libc we build against
+inline const char* findLineEnd(const char* p, const char* end) {
+	const char* nl = (const char*)memchr(p, '\n', end - p);
+	return nl ? nl : end;
+}
+
+// Split [begin, end) into at most maxChunks pieces of at least minChunk bytes, each starting at a line start.
+// Returns the chunk boundaries (chunk i is [bounds[i], bounds[i + 1])).
+inline std::vector<const char*> splitAtLines(const char* begin, const char* end, size_t minChunk, size_t maxChunks) {
+	size_t chunks = (size_t)(end - begin) / minChunk;
+	chunks = (chunks < 1) ? 1 : (chunks > maxChunks ? maxChunks : chunks);
+	std::vector<const char*> bounds(1, begin);
+	for (size_t i = 1; i < chunks; i++) {
+		const char* p = begin + (size_t)(end - begin) * i / chunks;
+		if (p <= bounds.back())
+			continue;
+		p = findLineEnd(p, end);
+		if (p < end) bounds.push_back(p + 1);
+	}
+	bounds.push_back(end);
+	return bounds;
+}
+
+// Count the newlines before p (only used to report line numbers in error messages)
+inline size_t lineNumber(const char* begin, const char* p) {
+	size_t n = 1;
+	for (const char* q = begin; q < p; ++q)
+		n += (*q == '\n');
+	return n;
+}
+
+// Throw an error that points at the offending line
+[[noreturn]] inline void parseError(const std::string& filename, const char* begin, const char* p, const char* what) {
+	std::stringstream ss;
+	ss << "Error reading " << filename << ": " << what << " on line " << lineNumber(begin, p);
+	throw std::runtime_error(ss.str());
+}
+
+// Parse a number at p (after skipping blanks) and advance p past it; returns false on failure
+inline bool parseFloat(const char*& p, const char* end, float& value) {
+	p = skipBlanks(p, end);
+	if (p < end && *p == '+') ++p;  // from_chars does not accept an explicit plus sign
+	auto res = std::from_chars(p, end, value);
+	if (res.ec != std::errc()) return false;
+	p = res.ptr;
+	return true;
+}
+
+inline bool parseFloat(const char*& p, const char* end, double& value) {
+	p = skipBlanks(p, end);
+	if (p < end && *p == '+') ++p;
+	auto res = std::from_chars(p, end, value);
+	if (res.ec != std::errc()) return false;
+	p = res.ptr;
+	return true;
+}
+
+inline bool parseInt(const char*& p, const char* end, long& value) {
+	p = skipBlanks(p, end);
+	if (p < end && *p == '+') ++p;
+	auto res = std::from_chars(p, end, value);
+	if (res.ec != std::errc()) return false;
+	p = res.ptr;
+	return true;
+}
+
+#endif
@@ -0,0 +1,103 @@
+#include "threadpool.hpp"
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <exception>
+
+// Start the worker threads
+ThreadPool::ThreadPool(size_t threads) : stopping(false) {
+	for (size_t i = 0; i < threads; i++)
+		workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+// Finish the queued tasks and join the workers
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto& t : workers)
+		t.join();
+}
+
+ThreadPool& ThreadPool::instance() {
+	// The calling thread also works, so one fewer worker than cores
+	static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+	return pool;
+}
+
+void ThreadPool::workerLoop() {
+	while (true) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return stopping || !tasks.empty(); });
+			if (tasks.empty())
+				return;  // stopping and nothing left to do
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+		task();
+	}
+}
+
+void ThreadPool::parallelFor(size_t n, const std::function<void(size_t)>& fn) {
+	if (n == 0)
+		return;
+	if (n == 1 || workers.empty()) {
+		for (size_t i = 0; i < n; i++)
+			fn(i);
+		return;
+	}
+
+	// Shared by the caller and the helpers; helpers may still hold it after we return
+	struct Job {
+		std::atomic<size_t> next{ 0 };	// Next index to claim
+		std::atomic<size_t> done{ 0 };	// Number of finished indices
+		size_t n;
+		const std::function<void(size_t)>* fn;
+		std::exception_ptr error;
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+	auto job = std::make_shared<Job>();
+	job->n = n;
+	job->fn = &fn;
+
+	// Claim indices until none are left. Only indices that were claimed are ever waited on,
+	// and those are running on some thread, so nesting cannot deadlock.
+	auto work = [](const std::shared_ptr<Job>& job) {
+		size_t i;
+		while ((i = job->next++) < job->n) {
+			try {
+				(*job->fn)(i);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(job->mutex);
+				if (!job->error)
+					job->error = std::current_exception();
+			}
+			if (++job->done == job->n) {
+				std::lock_guard<std::mutex> lock(job->mutex);
+				job->finished.notify_all();
+			}
+		}
+	};
+
+	size_t helpers = std::min(workers.size(), n - 1);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (size_t h = 0; h < helpers; h++)
+			tasks.push_back([job, work] { work(job); });
+	}
+	if (helpers == 1) wake.notify_one();
+	else wake.notify_all();
+
+	work(job);
+	{
+		std::unique_lock<std::mutex> lock(job->mutex);
+		job->finished.wait(lock, [&] { return job->done == job->n; });
+	}
+	if (job->error)
+		std::rethrow_exception(job->error);
+}
@@ -0,0 +1,43 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Worker threads shared by the CPU-side loading code
+class ThreadPool {
+public:
+	ThreadPool(size_t threads);
+	~ThreadPool();
+	// Disallow copy, move, & assignment
+	ThreadPool(const ThreadPool& other) = delete;
+	ThreadPool& operator=(const ThreadPool& other) = delete;
+	ThreadPool(ThreadPool&& other) = delete;
+	ThreadPool& operator=(ThreadPool&& other) = delete;
+
+	// The process-wide pool, sized to the number of cores
+	static ThreadPool& instance();
+
+	// Call fn(i) for every i in [0, n) and return once all calls are done.
+	// The calling thread works on the range too, so this may be called from inside another task.
+	// The first exception thrown by fn is rethrown here.
+	void parallelFor(size_t n, const std::function<void(size_t)>& fn);
+
+	// Number of threads that can work on a parallelFor (the workers plus the caller)
+	inline size_t concurrency() const { return workers.size() + 1; }
+
+protected:
+	void workerLoop();
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> tasks;	// Pending tasks
+	std::mutex mutex;							// Guards tasks and stopping
+	std::condition_variable wake;				// Signaled when a task is queued or the pool stops
+	bool stopping;
+};
+
+#endif
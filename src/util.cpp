@@ -1,10 +1,18 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <cstring>
+#include <algorithm>
 #include "util.hpp"
+#include <GL/freeglut.h>
 
 // Compile a single shader stage
 GLuint compileShader(GLenum type, const std::string& filename) {
+	return compileShaderSource(type, readShaderFile(filename), filename);
+}
+
+// Read the source of a shader stage
+std::string readShaderFile(const std::string& filename) {
 	// Read the file
 	std::ifstream file(filename);
 	if (!file.is_open()) {
@@ -16,9 +24,13 @@ GLuint compileShader(GLenum type, const std::string& filename) {
 	// Read the shader source
 	std::stringstream buffer;
 	buffer << file.rdbuf();
-	std::string bufStr = buffer.str();
-	const char* bufCStr = bufStr.c_str();
-	GLint length = (GLint)bufStr.length();
+	return buffer.str();
+}
+
+// Compile a shader stage from source; name is used in error messages
+GLuint compileShaderSource(GLenum type, const std::string& source, const std::string& name) {
+	const char* bufCStr = source.c_str();
+	GLint length = (GLint)source.length();
 
 	// Compile the shader
 	GLuint shader = glCreateShader(type);
@@ -29,16 +41,10 @@ GLuint compileShader(GLenum type, const std::string& filename) {
 	GLint status;
 	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
 	if (status == GL_FALSE) {
-		// Compilation failed, get the info log
-		GLint logLength;
-		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logLength);
-		std::vector<GLchar> logText(logLength);
-		glGetShaderInfoLog(shader, logLength, NULL, logText.data());
-
 		// Construct an error message with the compile log
 		std::stringstream ss;
-		ss << "Error compiling " << filename << ":" << std::endl << std::endl;
-		ss << logText.data() << std::endl;
+		ss << "Error compiling " << name << ":" << std::endl << std::endl;
+		ss << shaderInfoLog(shader) << std::endl;
 
 		// Cleanup shader and throw an exception
 		glDeleteShader(shader);
@@ -48,9 +54,10 @@ GLuint compileShader(GLenum type, const std::string& filename) {
 	return shader;
 }
 
-// Link compiled shader stages into a single program
-GLuint linkProgram(std::vector<GLuint>& shaders) {
-	GLuint program = glCreateProgram();
+// Link compiled shader stages into a single program, a new one unless one is given
+GLuint linkProgram(std::vector<GLuint>& shaders, GLuint program) {
+	if (!program)
+		program = glCreateProgram();
 
 	// Attach the shaders and link the program
 	for (auto it = shaders.begin(); it != shaders.end(); ++it)
@@ -65,16 +72,10 @@ GLuint linkProgram(std::vector<GLuint>& shaders) {
 	GLint status;
 	glGetProgramiv(program, GL_LINK_STATUS, &status);
 	if (status == GL_FALSE) {
-		// Link failed, get the info log
-		GLint logLength;
-		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
-		std::vector<GLchar> logText(logLength);
-		glGetProgramInfoLog(program, logLength, NULL, logText.data());
-
-		// Construct an error message with the compile log
+		// Construct an error message with the link log
 		std::stringstream ss;
 		ss << "Error linking shader program:" << std::endl << std::endl;
-		ss << logText.data() << std::endl;
+		ss << programInfoLog(program) << std::endl;
 
 		// Cleanup program and throw an exception
 		glDeleteProgram(program);
@@ -83,3 +84,34 @@ GLuint linkProgram(std::vector<GLuint>& shaders) {
 
 	return program;
 }
+
+std::string shaderInfoLog(GLuint shader) {
+	GLint logLength = 0;
+	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logLength);
+	std::vector<GLchar> logText(std::max(logLength, 1), 0);
+	glGetShaderInfoLog(shader, (GLsizei)logText.size(), NULL, logText.data());
+	return logText.data();
+}
+
+std::string programInfoLog(GLuint program) {
+	GLint logLength = 0;
+	glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
+	std::vector<GLchar> logText(std::max(logLength, 1), 0);
+	glGetProgramInfoLog(program, (GLsizei)logText.size(), NULL, logText.data());
+	return logText.data();
+}
+
+bool hasExtension(const char* name) {
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++) {
+		const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		if (ext && strcmp(ext, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+void* getProcAddress(const char* name) {
+	return (void*)glutGetProcAddress(name);
+}
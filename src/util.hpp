@@ -6,6 +6,16 @@
 #include "gl_core_3_3.h"
 
 GLuint compileShader(GLenum type, const std::string& filename);
-GLuint linkProgram(std::vector<GLuint>& shaders);
+std::string readShaderFile(const std::string& filename);
+GLuint compileShaderSource(GLenum type, const std::string& source, const std::string& name);
+GLuint linkProgram(std::vector<GLuint>& shaders, GLuint program = 0);
+// Compile or link messages of a shader or program
+std::string shaderInfoLog(GLuint shader);
+std::string programInfoLog(GLuint program);
+
+// Whether the current context advertises an extension (e.g. "GL_ARB_buffer_storage")
+bool hasExtension(const char* name);
+// Address of an entry point outside GL 3.3 core, or nullptr
+void* getProcAddress(const char* name);
 
 #endif
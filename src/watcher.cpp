@@ -0,0 +1,82 @@
+#define NOMINMAX
+#include "watcher.hpp"
+#include <algorithm>
+#include <system_error>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <climits>
+#endif
+namespace fs = std::filesystem;
+
+// Time between modification time scans when inotify is not available
+static const std::chrono::milliseconds scanInterval(250);
+
+FileWatcher::FileWatcher(const std::string& dir) : dir(dir), watching(false), fd(-1) {
+#ifdef __linux__
+	// Editors either rewrite a file in place or write a new one and rename it over the old
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd >= 0 && inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) >= 0) {
+		watching = true;
+		return;
+	}
+	if (fd >= 0) {
+		close(fd);
+		fd = -1;
+	}
+#endif
+	std::error_code ec;
+	watching = fs::is_directory(dir, ec);
+	scan(nullptr);
+	lastScan = std::chrono::steady_clock::now();
+}
+
+FileWatcher::~FileWatcher() {
+#ifdef __linux__
+	if (fd >= 0)
+		close(fd);
+#endif
+}
+
+std::vector<std::string> FileWatcher::poll() {
+	std::vector<std::string> changed;
+#ifdef __linux__
+	if (fd >= 0) {
+		alignas(inotify_event) char buf[16 * (sizeof(inotify_event) + NAME_MAX + 1)];
+		ssize_t n;
+		while ((n = read(fd, buf, sizeof(buf))) > 0) {
+			for (char* p = buf; p < buf + n;) {
+				const inotify_event* e = (const inotify_event*)p;
+				if (e->len && !(e->mask & IN_ISDIR))
+					changed.push_back((fs::path(dir) / e->name).string());
+				p += sizeof(inotify_event) + e->len;
+			}
+		}
+		std::sort(changed.begin(), changed.end());
+		changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+		return changed;
+	}
+#endif
+	if (watching && std::chrono::steady_clock::now() - lastScan >= scanInterval) {
+		scan(&changed);
+		lastScan = std::chrono::steady_clock::now();
+	}
+	return changed;
+}
+
+// Record the write time of every file, listing the ones that differ from the last scan
+void FileWatcher::scan(std::vector<std::string>* changed) {
+	std::error_code ec;
+	for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+		if (!it->is_regular_file(ec))
+			continue;
+		std::string path = it->path().string();
+		fs::file_time_type t = it->last_write_time(ec);
+		auto found = times.find(path);
+		if (found == times.end() || found->second != t) {
+			if (changed)
+				changed->push_back(path);
+			times[path] = t;
+		}
+	}
+}
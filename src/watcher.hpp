@@ -0,0 +1,37 @@
+#ifndef WATCHER_HPP
+#define WATCHER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <filesystem>
+
+// Reports files of a directory that were written since the last poll, without blocking.
+// Uses inotify on Linux; elsewhere the modification times are compared, a few times a second.
+class FileWatcher {
+public:
+	explicit FileWatcher(const std::string& dir);
+	~FileWatcher();
+	// Disallow copy, move, & assignment
+	FileWatcher(const FileWatcher& other) = delete;
+	FileWatcher& operator=(const FileWatcher& other) = delete;
+	FileWatcher(FileWatcher&& other) = delete;
+	FileWatcher& operator=(FileWatcher&& other) = delete;
+
+	// Paths (dir/name) of the files changed since the last call, each listed once
+	std::vector<std::string> poll();
+	// Whether changes can be seen at all (false if the directory could not be watched)
+	inline bool isWatching() const { return watching; }
+
+protected:
+	std::string dir;
+	bool watching;
+	int fd;		// inotify instance, -1 if not used
+	// Fallback: last seen write time of each file, and when they were last compared
+	std::map<std::string, std::filesystem::file_time_type> times;
+	std::chrono::steady_clock::time_point lastScan;
+	void scan(std::vector<std::string>* changed);
+};
+
+#endif